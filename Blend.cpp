@@ -0,0 +1,216 @@
+#include <algorithm>
+#include <random>
+#include <unordered_map>
+#include <utility>
+#include "Blend.hpp"
+#include "Parser.hpp"
+#include "utils/parallel.hpp"
+
+void Blend::add(std::unique_ptr<Dictionary> dictionary, double weight) {
+    components.push_back(Component{std::move(dictionary), weight});
+}
+
+bool Blend::empty() const {
+    return components.empty();
+}
+
+std::string Blend::generate(const std::string &seed) const {
+    static thread_local std::mt19937 gen(std::random_device{}());
+
+    const Topic               noTopic{};
+    std::vector<Track>        tracks(components.size());
+    std::vector<const Word *> sentence{};
+
+    // Add a word to the sentence and move every cursor past it. A dictionary not knowing the word
+    // has no context until the next word it knows. Markers are known to all, so stacks stay in step.
+    auto append = [this, &tracks, &sentence](const Word *word) {
+        sentence.push_back(word);
+        for (unsigned long i = 0; i < components.size(); ++i) {
+            const Dictionary *dictionary = components[i].dictionary.get();
+            Track            &track      = tracks[i];
+            const Word       *own        = dictionary->findWord(word->getInputText());
+            const Gram       *context    = track.contexts.empty() ? nullptr : track.contexts.back();
+
+            track.contexts.push_back(own ? dictionary->advance(context, own) : nullptr);
+            if (own == nullptr) {
+                continue;
+            }
+            if (own->isBeginMarker()) {
+                track.markerStack.push(own);
+            } else if (own->isEndMarker() && !track.markerStack.empty() && track.markerStack.top() == own->getBeginMarker()) {
+                track.markerStack.pop();
+            }
+        }
+    };
+
+    const Dictionary *first = components.front().dictionary.get();
+    append(first->findWord("<s>"));
+
+    for (const auto &text:Parser::parseChunk(seed)) {
+        for (const auto &component:components) {
+            const Word *word = component.dictionary->findWord(text);
+            if (word != nullptr) {
+                append(word);
+                break;
+            }
+        }
+    }
+
+    const MarkerStack   &markers        = tracks.front().markerStack;
+    bool                finishSentence  = false;
+    std::vector<double> weights(components.size());
+
+    while (!markers.empty() && sentence.size() < Dictionary::maxSentenceLength * 4) {
+        for (unsigned long i = 0; i < components.size(); ++i) {
+            weights[i] = tracks[i].contexts.back() != nullptr ? components[i].weight : 0;
+        }
+
+        // Pick a dictionary by weight and sample it, leaving it out if it has nothing to follow
+        const Gram *next = nullptr;
+        while (next == nullptr) {
+            double total = 0;
+            for (auto weight:weights) {
+                total += weight;
+            }
+            if (total <= 0) {
+                break;
+            }
+
+            std::uniform_real_distribution<double> dis(0, total);
+            double                                 rnd  = dis(gen);
+            unsigned long                          pick = 0;
+            for (unsigned long i = 0; i < weights.size(); ++i) {
+                if (weights[i] > 0) {
+                    pick = i;
+                    if (rnd < weights[i]) {
+                        break;
+                    }
+                    rnd -= weights[i];
+                }
+            }
+
+            for (const Gram *context = tracks[pick].contexts.back(); context != nullptr && next == nullptr; context = context->getSuffix()) {
+                next = context->sample(tracks[pick].markerStack, noTopic, finishSentence);
+            }
+            weights[pick] = 0;
+        }
+
+        if (next == nullptr) {
+            break;
+        }
+
+        append(next->getWord());
+        if (sentence.size() > Dictionary::maxSentenceLength) {
+            finishSentence = true;
+        }
+    }
+
+    // Stuck or too long, close what is still open
+    while (!markers.empty()) {
+        append(markers.top()->getEndMarker());
+    }
+
+    return first->render(sentence);
+}
+
+/**
+ * Followers of the seed in every dictionary, most probable first by their blended probability.
+ * Each dictionary contributes the followers of the deepest context it has some for.
+ */
+std::vector<std::pair<const Word *, double>> Blend::rank(const std::string &seed) const {
+    const std::vector<std::string> words = Parser::parseChunk(seed);
+
+    // Context of every dictionary after the seed, none if it does not know the last words
+    std::vector<const Gram *> contexts(components.size(), nullptr);
+    double                    total = 0;
+    for (unsigned long i = 0; i < components.size(); ++i) {
+        const Dictionary *dictionary = components[i].dictionary.get();
+        const Gram       *context    = dictionary->advance(nullptr, dictionary->findWord("<s>"));
+        for (const auto &text:words) {
+            const Word *word = dictionary->findWord(text);
+            context = word ? dictionary->advance(context, word) : nullptr;
+        }
+        contexts[i] = context;
+        if (context != nullptr) {
+            total += components[i].weight;
+        }
+    }
+
+    std::vector<const Word *>                      candidates{};
+    std::unordered_map<std::string, unsigned long> indices{};
+    for (auto context:contexts) {
+        for (; context != nullptr; context = context->getSuffix()) {
+            if (context->size() > 0) {
+                for (const Gram *gram:context->candidates({}, 0)) {
+                    if (indices.emplace(gram->getWord()->getInputText(), candidates.size()).second) {
+                        candidates.push_back(gram->getWord());
+                    }
+                }
+                break;
+            }
+        }
+    }
+
+    // Probability of every candidate in every dictionary, side by side when there are many
+    std::vector<std::vector<double>> probabilities(components.size());
+    auto                             score = [this, &contexts, &candidates, &probabilities](unsigned long i) {
+        if (contexts[i] == nullptr) {
+            return;
+        }
+        const Dictionary *dictionary = components[i].dictionary.get();
+        probabilities[i].assign(candidates.size(), 0);
+        for (unsigned long c = 0; c < candidates.size(); ++c) {
+            const Word *own = dictionary->findWord(candidates[c]->getInputText());
+            if (own != nullptr) {
+                probabilities[i][c] = dictionary->probability(contexts[i], own);
+            }
+        }
+    };
+    if (candidates.size() >= parallelFanout) {
+        parallelFor(components.size(), score);
+    } else {
+        for (unsigned long i = 0; i < components.size(); ++i) {
+            score(i);
+        }
+    }
+
+    std::vector<std::pair<const Word *, double>> ranked{};
+    ranked.reserve(candidates.size());
+    for (unsigned long c = 0; c < candidates.size(); ++c) {
+        double probability = 0;
+        for (unsigned long i = 0; i < components.size(); ++i) {
+            if (!probabilities[i].empty()) {
+                probability += components[i].weight / total * probabilities[i][c];
+            }
+        }
+        ranked.emplace_back(candidates[c], probability);
+    }
+    std::stable_sort(
+        ranked.begin(), ranked.end(),
+        [](const std::pair<const Word *, double> &a, const std::pair<const Word *, double> &b) {
+            return a.second > b.second;
+        }
+    );
+
+    return ranked;
+}
+
+std::vector<std::string> Blend::nextCandidateWords(const std::string &seed, unsigned long count) const {
+    std::vector<std::string> results{};
+    for (const auto &candidate:rank(seed)) {
+        if (results.size() == count) {
+            break;
+        }
+        results.push_back(candidate.first->getOutputText());
+    }
+    return results;
+}
+
+std::string Blend::nextMostProbableWord(const std::string &seed) const {
+    for (const auto &candidate:rank(seed)) {
+        if (!candidate.first->isMarker()) {
+            return candidate.first->getOutputText();
+        }
+    }
+    return "";
+}
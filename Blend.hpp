@@ -0,0 +1,45 @@
+#ifndef SHINGLES_BLEND_HPP
+#define SHINGLES_BLEND_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "Dictionary.hpp"
+
+/**
+ * Weighted mixture of dictionaries, such as 70% of a support model and 30% of a docs one.
+ * Each dictionary keeps its own vocabulary and follows the sentence with its own context cursor,
+ * words being matched by text. A next word is drawn by picking a dictionary by weight then sampling
+ * it from its context (backing off along suffix links), which samples the weighted sum of their
+ * distributions. Dictionaries with nothing to follow the context are left out and the others
+ * reweighted. Completions rank the followers of every dictionary by their blended probability.
+ */
+class Blend {
+public:
+    void add(std::unique_ptr<Dictionary> dictionary, double weight);
+    bool empty() const;
+    std::string generate(const std::string &seed = "") const;
+    std::vector<std::string> nextCandidateWords(const std::string &seed = "", unsigned long count = 10) const;
+    std::string nextMostProbableWord(const std::string &seed = "") const;
+
+private:
+    // Blended completions are scored one dictionary per task past this many candidates
+    static const unsigned long parallelFanout{1024};
+
+    struct Component {
+        std::unique_ptr<Dictionary> dictionary;
+        double                      weight;
+    };
+
+    // Where a dictionary is along the sentence, context cursor after each word and its open markers
+    struct Track {
+        std::vector<const Gram *> contexts{};
+        MarkerStack               markerStack{};
+    };
+
+    std::vector<std::pair<const Word *, double>> rank(const std::string &seed) const;
+
+    std::vector<Component> components{};
+};
+
+#endif //SHINGLES_BLEND_HPP
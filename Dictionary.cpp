@@ -1,10 +1,25 @@
 #include <json/json.h>
 #include <fstream>
 #include <chrono>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <iterator>
+#include <limits>
+#include <future>
+#include <thread>
 #include <utility>
 #include "Dictionary.hpp"
 #include "Parser.hpp"
+#include "Journal.hpp"
+#include "NgramRuns.hpp"
 #include "utils/color.hpp"
+#include "utils/files.hpp"
+#include "utils/number.hpp"
+#include "utils/parallel.hpp"
+#include "utils/text.hpp"
+
+const std::string Dictionary::binaryMagic = "SHGL";
 
 Dictionary::Dictionary(unsigned long n) : n(n) {
     std::unique_ptr<Word> beginSentence{std::make_unique<Word>(0, "<s>", "")};
@@ -29,6 +44,9 @@ Dictionary::Dictionary(unsigned long n) : n(n) {
     wordMap[endQuote->getInputText()]      = std::move(endQuote);
     wordMap[beginParens->getInputText()]   = std::move(beginParens);
     wordMap[endParens->getInputText()]     = std::move(endParens);
+
+    indexVocabulary();
+    selectWalkers();
 }
 
 
@@ -41,18 +59,145 @@ void Dictionary::setDebug(bool debug) {
     debug_ = debug;
 }
 
+void Dictionary::setBestOf(unsigned long bestOf) {
+    std::cout << "Best of: " << bestOf << std::endl;
+    bestOf_ = bestOf;
+}
+
+void Dictionary::setBeamWidth(unsigned long beamWidth) {
+    std::cout << "Beam width: " << beamWidth << std::endl;
+    beamWidth_ = beamWidth;
+}
+
+void Dictionary::setTopicWeight(double topicWeight) {
+    std::cout << "Topic weight: " << topicWeight << std::endl;
+    topicWeight_ = topicWeight;
+}
+
+/**
+ * Count grams of order 3 and up in a fixed size sketch, only keeping in the dictionary
+ * those seen at least threshold times. 0 or 1 counts everything exactly.
+ */
+void Dictionary::setSketch(unsigned long threshold) {
+    sketchThreshold_ = threshold;
+    if (threshold > 1) {
+        sketch_ = std::make_unique<CountMinSketch>();
+        std::cout << "Counting grams of order 3 and up in a " << (sketch_->bytes() / 1048576.0)
+                  << "MB sketch, kept after " << threshold << " occurrences" << std::endl;
+    } else {
+        sketch_.reset();
+    }
+}
+
+void Dictionary::setDedup(unsigned long copies) {
+    dedupCopies_ = copies;
+    if (copies > 0) {
+        dedup_ = std::make_unique<CountMinSketch>();
+        std::cout << "Counting at most " << copies << " cop" << (copies > 1 ? "ies" : "y")
+                  << " of a sentence, fingerprinted in a " << (dedup_->bytes() / 1048576.0) << "MB sketch" << std::endl;
+    } else {
+        dedup_.reset();
+    }
+}
+
+void Dictionary::reportDedup() {
+    if (dedup_ && dedupSentences_ > 0) {
+        std::cout << "    Skipped " << dedupSkipped_ << " duplicate sentences out of " << dedupSentences_ << " ("
+                  << (100.0 * dedupSkipped_ / dedupSentences_) << "%)" << std::endl;
+    }
+    dedupSentences_ = 0;
+    dedupSkipped_   = 0;
+}
+
+/**
+ * Weight of the text typed in (see input), so that a conversation can count more than the corpus.
+ */
+void Dictionary::setInputWeight(double weight) {
+    if (!(weight > 0) || !std::isfinite(weight)) {
+        std::cerr << "Invalid weight: " << weight << std::endl;
+        return;
+    }
+    inputWeight_ = weight;
+}
+
 void Dictionary::ingestFile(const std::string &filePath) {
-    std::cout << "Loading text from " << filePath << " ..." << std::endl;
-    auto start        = std::chrono::high_resolution_clock::now();
+    ingestFiles({filePath});
+}
 
-    std::string text;
-    int         lines = 0;
-    {
-        std::ifstream file(filePath, std::ios::binary);
-        if (!file) {
-            std::cerr << "File not found!" << std::endl;
-            return;
-        } else {
+namespace {
+    struct ParsedFile {
+        std::string   path;
+        unsigned long bytes{0};
+        TokenizedText text{};
+    };
+
+    /**
+     * Split the weight off a source given as <pattern>:<weight>, 1 if it ends with no valid weight.
+     */
+    double splitWeight(std::string &pattern) {
+        size_t colon  = pattern.rfind(':');
+        double weight = 1;
+        if (colon == std::string::npos || !parseNumber(pattern.substr(colon + 1), weight) || weight <= 0) {
+            return 1;
+        }
+        pattern.resize(colon);
+        return weight;
+    }
+}
+
+/**
+ * Ingest files, directories, glob patterns or @file lists as a single pipelined job:
+ * while the words of a file are counted, the following files are being read and tokenized.
+ * A source ending with :<weight> has its sentences counted that many times.
+ * Probabilities are only updated once everything is ingested.
+ */
+void Dictionary::ingestFiles(const std::vector<std::string> &patterns) {
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::vector<std::pair<std::string, double>> paths{};
+    bool                                        standardInput       = false;
+    double                                      standardInputWeight = 1;
+    for (auto pattern:patterns) {
+        double weight = splitWeight(pattern);
+        if (pattern == "-") {
+            standardInput       = true;
+            standardInputWeight = weight;
+            continue;
+        }
+        for (const auto &path:listFiles(pattern)) {
+            paths.emplace_back(path, weight);
+        }
+    }
+
+    if (paths.empty() && !standardInput) {
+        std::cerr << "Nothing to parse." << std::endl;
+        return;
+    }
+
+    unsigned long totalBytes = 0;
+
+    if (standardInput) {
+        std::cout << "Ingesting standard input..." << std::endl;
+        totalBytes += ingestBlocks(std::cin, standardInputWeight);
+    }
+
+    if (!paths.empty()) {
+        std::cout << "Ingesting " << paths.size() << " file" << (paths.size() > 1 ? "s" : "") << "..." << std::endl;
+    }
+
+    auto load = [this](const std::pair<std::string, double> &source) {
+        const std::string &path = source.first;
+        ParsedFile        parsed{path};
+        parsed.text.weight = source.second;
+
+        std::string text;
+        int         lines = 0;
+        {
+            std::ifstream file(path, std::ios::binary);
+            if (!file) {
+                std::cerr << "File not found: " << path << std::endl;
+                return parsed;
+            }
             while (file) {
                 std::string line;
                 std::getline(file, line);
@@ -65,46 +210,251 @@ void Dictionary::ingestFile(const std::string &filePath) {
                 }
             }
         }
-    }
 
-    if (text.empty()) {
-        std::cerr << "Nothing to parse." << std::endl;
-        exit(1);
+        parsed.bytes = text.size();
+        Parser::parse(
+            text,
+            [this, &parsed](std::vector<std::string> &words) {
+                tokenize(words, parsed.text);
+            },
+            []() {},
+            debug_
+        );
+        return parsed;
+    };
+
+    // Keep a bounded number of files in flight ahead of the counting
+    unsigned long                       window = std::max(2u, threadCount());
+    std::deque<std::future<ParsedFile>> pool{};
+    unsigned long                       next   = 0;
+
+    for (unsigned long done = 0; done < paths.size(); ++done) {
+        while (next < paths.size() && pool.size() < window) {
+            pool.push_back(std::async(std::launch::async, load, paths[next++]));
+        }
+
+        ParsedFile parsed = pool.front().get();
+        pool.pop_front();
+
+        ingest(parsed.text);
+
+        totalBytes += parsed.bytes;
+        double elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count();
+        std::cout << "    [" << done + 1 << "/" << paths.size() << "] " << parsed.path << " ("
+                  << (totalBytes / 1048576.0) << "MB, " << (elapsed > 0 ? totalBytes / 1048.576 / elapsed : 0) << "MB/s)"
+                  << std::endl;
     }
 
-    std::cout << "Parsing/Ingesting..." << std::endl;
-    Parser::parse(
-        text,
-        [this](std::vector<std::string> &words) {
-            ingest(words);
-        },
-        [this]() {
-            std::cout << "Updating probabilities..." << std::endl;
-            updateProbabilities();
-            std::cout << "Done!" << std::endl << std::endl;
-        },
-        debug_
-    );
+    reportDedup();
+    remapIds();
+
+    std::cout << "Updating probabilities..." << std::endl;
+    updateProbabilities();
+    std::cout << "Done!" << std::endl << std::endl;
+
+    compactJournal();
 
     double delta = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count();
-    std::cout << "Loaded in " << delta << "ms." << std::endl;
+    std::cout << "Loaded " << (totalBytes / 1048576.0) << "MB in " << delta << "ms ("
+              << (delta > 0 ? totalBytes / 1048.576 / delta : 0) << "MB/s)." << std::endl;
 }
 
-void Dictionary::open(const std::string &path) {
-    Json::Value root;
+/**
+ * Ingest a stream read in fixed-size blocks, cut at paragraph boundaries as they arrive.
+ * Only a bounded number of blocks are being parsed at any time, so memory stays constant
+ * whatever the size of the input. Probabilities are not updated.
+ * @return Number of bytes read
+ */
+unsigned long Dictionary::ingestBlocks(std::istream &stream, double weight) {
+    static const unsigned long blockSize = 1 << 20;
+
+    auto parseBlock = [this, weight](const std::string &block) {
+        TokenizedText text{};
+        text.weight = weight;
+        for (const auto &paragraph:Parser::splitParagraphs(block)) {
+            tokenize(Parser::parseChunk(paragraph), text);
+        }
+        return text;
+    };
+
+    unsigned long                          window = std::max(2u, threadCount());
+    std::deque<std::future<TokenizedText>> pool{};
+
+    // Count the words of the oldest blocks until only `keep` are left in flight
+    auto drain = [this, &pool](unsigned long keep) {
+        while (pool.size() > keep) {
+            ingest(pool.front().get());
+            pool.pop_front();
+        }
+    };
+
+    std::vector<char> buffer(blockSize);
+    std::string       pending{};
+    unsigned long     bytes = 0;
+
+    while (stream) {
+        stream.read(buffer.data(), buffer.size());
+        auto read = static_cast<unsigned long>(stream.gcount());
+        if (read == 0) {
+            break;
+        }
+        bytes += read;
+        pending.append(buffer.data(), read);
+
+        if (pending.size() < blockSize) {
+            continue;
+        }
+
+        // Cut at the last paragraph break, falling back to the last line or word for very long paragraphs
+        size_t cut = pending.rfind("\n\n");
+        if (cut == std::string::npos) {
+            cut = pending.rfind('\n');
+        }
+        if (cut == std::string::npos) {
+            cut = pending.rfind(' ');
+        }
+        cut = cut == std::string::npos ? pending.size() : cut + 1;
+
+        drain(window - 1);
+        pool.push_back(std::async(std::launch::async, parseBlock, pending.substr(0, cut)));
+        pending.erase(0, cut);
+
+        if (debug_) {
+            std::cout << "    " << (bytes / 1048576.0) << "MB read" << std::endl;
+        }
+    }
+
+    if (!pending.empty()) {
+        pool.push_back(std::async(std::launch::async, parseBlock, pending));
+    }
+    drain(0);
+
+    return bytes;
+}
+
+bool Dictionary::open(const std::string &path) {
+    std::string magic(binaryMagic.size(), '\0');
     {
         std::ifstream file(path, std::ios::binary);
         if (!file) {
             std::cerr << "File not found!" << std::endl;
-            return;
-        } else {
-            std::cout << "Loading dictionary: " << path << std::endl;
-            try {
-                file >> root;
-            } catch (...) {
-                std::cerr << "Invalid dictionary file!" << std::endl;
+            return false;
+        }
+        file.read(&magic[0], magic.size());
+    }
+
+    std::cout << "Loading dictionary: " << path << std::endl;
+
+    std::string                                              id{};
+    std::unordered_map<unsigned long, std::unique_ptr<Word>> wordsById{};
+    // A file that fails to load leaves the current dictionary as it was, journal included
+    const unsigned long previousN = n;
+    if (!(magic == binaryMagic ? readBinary(path, id, wordsById) : readJson(path, id, wordsById))) {
+        n = previousN;
+        return false;
+    }
+    selectWalkers();
+
+    // Stop journaling to the previous dictionary, what is learned while opening is not new
+    journal.close();
+
+    if (!wordsById.empty()) {
+        wordMap.clear();
+        std::cout << "    Linking grams..." << std::endl;
+        std::vector<Word *> words{};
+        for (auto &word:wordsById) {
+            words.push_back(word.second.get());
+        }
+        parallelFor(
+            words.size(),
+            [&words](unsigned long i) {
+                words[i]->linkSuffixes();
+            }
+        );
+
+        std::cout << "    Moving words..." << std::endl;
+        for (auto &word:wordsById) {
+            wordMap[word.second->getInputText()] = std::move(word.second);
+        }
+        indexVocabulary();
+    }
+
+    idCounter = wordMap.size() - 1;
+
+    beginSentence = wordMap["<s>"].get();
+    endSentence   = wordMap["</s>"].get();
+    beginSentence->setAsBeginMarker(endSentence);
+    endSentence->setAsEndMarker(beginSentence);
+    wordMap["<q>"]->setAsBeginMarker(wordMap["</q>"].get());
+    wordMap["</q>"]->setAsEndMarker(wordMap["<q>"].get());
+    wordMap["<p>"]->setAsBeginMarker(wordMap["</p>"].get());
+    wordMap["</p>"]->setAsEndMarker(wordMap["<p>"].get());
+
+    countScale_    = 1;
+    countCarry_    = 0;
+    journalWeight_ = 1;
+
+    // The journal only holds what was counted, it is replayed without deduplication. Fingerprints are
+    // keyed by word addresses, which the words just loaded may reuse, so deduplication starts over.
+    const bool deduplicating = dedup_ != nullptr;
+    dedup_.reset();
+    // Sketched grams are keyed by word addresses as well, counts of the previous words must not carry over
+    if (sketch_) {
+        sketch_ = std::make_unique<CountMinSketch>();
+    }
+    retiredWords_.clear();
+
+    // Replay what was learned since the snapshot was saved
+    const std::string journalPath = Journal::pathFor(path);
+    unsigned long     records     = Journal::replay(
+        journalPath, id,
+        [this](std::vector<std::string> &words) {
+            if (!Journal::isDirective(words)) {
+                ingest(words, journalWeight_);
                 return;
             }
+            // Directives are checked as when they were typed, a damaged one is skipped
+            double     value  = 0;
+            const bool parsed = parseNumber(words[1], value);
+            if (words[0] == "weight" && parsed && value > 0) {
+                journalWeight_ = value;
+            } else if (words[0] == "decay" && parsed && value > 0 && value <= 1) {
+                decay(value);
+            } else {
+                std::cerr << "Skipping invalid journal directive: " << words[0] << " " << words[1] << std::endl;
+            }
+        }
+    );
+    if (records > 0) {
+        std::cout << "    Replayed " << records << " journal records" << std::endl;
+    }
+    if (deduplicating) {
+        dedup_ = std::make_unique<CountMinSketch>();
+    }
+
+    remapIds();
+    indexWords();
+
+    this->path   = path;
+    snapshotSize = fileSize(path);
+    journal.open(journalPath, id);
+
+    std::cout << "    Calculating probabilities..." << std::endl;
+    updateProbabilities();
+
+    std::cout << "Done!" << std::endl;
+    return true;
+}
+
+bool Dictionary::readJson(const std::string &path, std::string &id, std::unordered_map<unsigned long, std::unique_ptr<Word>> &wordsById) {
+    Json::Value root;
+    {
+        std::ifstream file(path, std::ios::binary);
+        try {
+            file >> root;
+        } catch (...) {
+            std::cerr << "Invalid dictionary file!" << std::endl;
+            return false;
         }
     }
 
@@ -116,10 +466,10 @@ void Dictionary::open(const std::string &path) {
             n = n_json.asUInt64();
         }
 
-        const Json::Value words_json = root["words"];
-        if (!words_json.empty() && words_json.isArray()) {
-            std::unordered_map<unsigned long, std::unique_ptr<Word>> wordsById{};
+        id = root["journal"].asString();
 
+        const Json::Value &words_json = root["words"];
+        if (!words_json.empty() && words_json.isArray()) {
             // First pass add non-grammed words by id
             unsigned long numWords = words_json.size();
             std::cout << "    Adding " << numWords << " words..." << std::endl;
@@ -128,52 +478,340 @@ void Dictionary::open(const std::string &path) {
                 auto                  search = wordsById.find(w->getId());
                 if (search != wordsById.end()) {
                     std::cerr << "Duplicate word id: " << w->getId() << std::endl;
-                    return;
+                    return false;
                 }
                 wordsById[w->getId()] = std::move(w);
             }
 
-            // Second pass, add grams
+            // Second pass, add grams, each word's grams are independent and wordsById is only read from now on
             std::cout << "    Adding grams..." << std::endl;
-            for (auto &word_json : words_json) {
-                wordsById[word_json["id"].asUInt64()]->fromJson(word_json, wordsById);
-            }
+            const auto &words = wordsById;
+            parallelFor(
+                numWords,
+                [&words, &words_json](unsigned long i) {
+                    const Json::Value &word_json = words_json[static_cast<Json::ArrayIndex>(i)];
+                    words.at(word_json["id"].asUInt64())->fromJson(word_json, words);
+                }
+            );
+        }
+    } catch (...) {
+        std::cerr << "Error parsing dictionary! " << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Binary dictionary, all integers are varints:
+ *   magic, version, n, journal id, number of words
+ *   words ordered by id: id delta from the previous word, input text, output text
+ *   then for each word in the same order: byte size of its gram block, gram block (see Gram::toBinary)
+ */
+bool Dictionary::readBinary(const std::string &path, std::string &id, std::unordered_map<unsigned long, std::unique_ptr<Word>> &wordsById) {
+    std::string data;
+    {
+        std::ifstream file(path, std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
 
-            wordMap.clear();
-            std::cout << "    Moving words..." << std::endl;
-            for (auto &word:wordsById) {
-                wordMap[word.second->getInputText()] = std::move(word.second);
+    std::cout << "Learning dictionary..." << std::endl;
+
+    try {
+        BinaryReader reader(data.data() + binaryMagic.size(), data.data() + data.size());
+
+        unsigned long version = reader.varint();
+        if (version != binaryVersion) {
+            std::cerr << "Unsupported dictionary version: " << version << std::endl;
+            return false;
+        }
+
+        n  = reader.varint();
+        id = reader.string();
+
+        // First pass add non-grammed words by id
+        unsigned long numWords = reader.varint();
+        std::cout << "    Adding " << numWords << " words..." << std::endl;
+        std::vector<Word *> words{};
+        unsigned long       wordId = 0;
+        for (unsigned long i = 0; i < numWords; ++i) {
+            wordId += reader.varint();
+            std::string inputText  = reader.string();
+            std::string outputText = reader.string();
+            if (wordsById.find(wordId) != wordsById.end()) {
+                std::cerr << "Duplicate word id: " << wordId << std::endl;
+                return false;
             }
+            auto word = std::make_unique<Word>(wordId, std::move(inputText), std::move(outputText));
+            words.push_back(word.get());
+            wordsById[wordId] = std::move(word);
+        }
+
+        // Second pass, add grams, each word's grams are independent and wordsById is only read from now on
+        std::cout << "    Adding grams..." << std::endl;
+        std::vector<BinaryReader> blocks{};
+        for (unsigned long i = 0; i < numWords; ++i) {
+            blocks.push_back(reader.block(reader.varint()));
         }
+        const auto &wordsByIdView = wordsById;
+        parallelFor(
+            numWords,
+            [&words, &blocks, &wordsByIdView](unsigned long i) {
+                words[i]->fromBinary(blocks[i], wordsByIdView);
+            }
+        );
     } catch (...) {
         std::cerr << "Error parsing dictionary! " << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+std::string Dictionary::snapshotId() {
+    std::random_device rd;
+    std::stringstream  id;
+    id << std::hex << rd() << rd();
+    return id.str();
+}
+
+/**
+ * Build a binary dictionary from files without holding the grams in memory: sentences are counted
+ * as sorted runs on disk next to the dictionary, using about memory bytes, then merged into it.
+ * Only the vocabulary is kept, the grams are in the file once done.
+ */
+void Dictionary::build(const std::vector<std::string> &patterns, const std::string &path, unsigned long memory) {
+    // Only the vocabulary would be written, the grams in memory are not counted on disk
+    if (beginSentence->getGram()->getCount() > 0) {
+        std::cerr << "Can't build from a dictionary that already has grams, start from an empty one" << std::endl;
         return;
     }
 
-    idCounter = wordMap.size() - 1;
+    std::cout << "Building dictionary: " << path << std::endl;
 
-    beginSentence = wordMap["<s>"].get();
-    endSentence   = wordMap["</s>"].get();
-    beginSentence->setAsBeginMarker(endSentence);
-    endSentence->setAsEndMarker(beginSentence);
-    wordMap["<q>"]->setAsBeginMarker(wordMap["</q>"].get());
-    wordMap["</q>"]->setAsEndMarker(wordMap["<q>"].get());
-    wordMap["<p>"]->setAsBeginMarker(wordMap["</p>"].get());
-    wordMap["</p>"]->setAsEndMarker(wordMap["<p>"].get());
+    // The built sentences belong to the new dictionary, not to the journal of a previous one
+    journal.close();
 
-    std::cout << "    Calculating probabilities..." << std::endl;
-    updateProbabilities();
+    runs_ = std::make_unique<NgramRuns>(path, n, memory);
+    ingestFiles(patterns);
 
-    std::cout << "Done!" << std::endl;
+    if (writeRuns(path)) {
+        std::cout << "Built!" << std::endl;
+    }
+}
+
+namespace {
+    /**
+     * Turn the grams of a binary word block into weighted windows: each gram counts for the part of
+     * its count not passed on to its children, or all of it at depth n - 1 where children are cut.
+     * path holds the words of the gram, returns the count of the gram.
+     */
+    unsigned long mergeGram(
+        BinaryReader &reader, const std::unordered_map<unsigned long, Word *> &words,
+        std::vector<Word *> &path, unsigned long n, NgramRuns &runs
+    ) {
+        unsigned long count    = reader.varint();
+        unsigned long numGrams = reader.varint();
+        unsigned long children = 0;
+        unsigned long wordId   = 0;
+        for (unsigned long i = 0; i < numGrams; ++i) {
+            wordId += reader.varint();
+            auto search = words.find(wordId);
+            if (search == words.end()) {
+                std::cerr << "Unknown gram word: " << wordId << std::endl;
+                throw std::runtime_error("Invalid dictionary");
+            }
+            path.push_back(search->second);
+            children += mergeGram(reader, words, path, n, runs);
+            path.pop_back();
+        }
+
+        if (path.size() <= n) {
+            unsigned long own = path.size() == n ? count : count - std::min(count, children);
+            if (own > 0) {
+                runs.add(path, 0, path.size(), own);
+            }
+        }
+        return count;
+    }
+}
+
+/**
+ * Merge dictionaries into a new binary dictionary, summing their counts. Words are matched by text
+ * and the merged dictionary is an n-gram one for the smallest n of the inputs. Binary inputs are
+ * streamed one word block at a time into sorted runs (see build), only JSON ones are loaded.
+ */
+void Dictionary::merge(const std::vector<std::string> &paths, const std::string &path, unsigned long memory) {
+    struct Input {
+        std::unique_ptr<std::ifstream>                           file{};   // Binary, streamed
+        std::unordered_map<unsigned long, std::unique_ptr<Word>> loaded{}; // JSON, loaded by id
+        std::vector<Word *>                                      blocks{}; // Merged word of each block, binary only
+        std::unordered_map<unsigned long, Word *>                words{};  // Input id to merged word
+    };
+
+    auto mergeWord = [this](const std::string &inputText, const std::string &outputText) {
+        auto search = wordMap.find(inputText);
+        if (search != wordMap.end()) {
+            return search->second.get();
+        }
+        std::unique_ptr<Word> w    = std::make_unique<Word>(++idCounter, inputText, outputText);
+        Word                  *word = w.get();
+        wordMap[inputText] = std::move(w);
+        return word;
+    };
+
+    std::vector<Input> inputs(paths.size());
+    n = std::numeric_limits<unsigned long>::max();
+
+    try {
+        // Vocabularies first, to know the merged ids
+        for (unsigned long i = 0; i < paths.size(); ++i) {
+            Input &input = inputs[i];
+            input.file = std::make_unique<std::ifstream>(paths[i], std::ios::binary);
+            if (!*input.file) {
+                std::cerr << "File not found: " << paths[i] << std::endl;
+                return;
+            }
+
+            std::string magic(binaryMagic.size(), '\0');
+            input.file->read(&magic[0], magic.size());
+
+            if (magic == binaryMagic) {
+                std::cout << "Reading words of " << paths[i] << std::endl;
+                unsigned long version = readVarint(*input.file);
+                if (version != binaryVersion) {
+                    std::cerr << "Unsupported dictionary version: " << version << std::endl;
+                    return;
+                }
+                n = std::min(n, readVarint(*input.file));
+                readString(*input.file); // Snapshot id
+
+                unsigned long numWords = readVarint(*input.file);
+                unsigned long wordId   = 0;
+                for (unsigned long w = 0; w < numWords; ++w) {
+                    wordId += readVarint(*input.file);
+                    std::string inputText  = readString(*input.file);
+                    std::string outputText = readString(*input.file);
+                    Word        *word      = mergeWord(inputText, outputText);
+                    input.words[wordId] = word;
+                    input.blocks.push_back(word);
+                }
+            } else {
+                input.file.reset();
+                // Read without opening, an input has no journal to replay nor to start
+                Dictionary  reader{};
+                std::string id{};
+                if (!reader.readJson(paths[i], id, input.loaded)) {
+                    std::cerr << "Could not read dictionary: " << paths[i] << std::endl;
+                    return;
+                }
+                n = std::min(n, reader.n);
+                for (const auto &word:input.loaded) {
+                    input.words[word.first] = mergeWord(word.second->getInputText(), word.second->getOutputText());
+                }
+            }
+        }
+
+        std::cout << "Merging into a " << n << "-gram dictionary: " << path << std::endl;
+        runs_ = std::make_unique<NgramRuns>(path, n, memory);
+
+        for (unsigned long i = 0; i < paths.size(); ++i) {
+            Input               &input = inputs[i];
+            std::vector<Word *> gramPath{};
+            std::string         block{};
+            std::cout << "    Counting " << paths[i] << std::endl;
+
+            if (input.file) {
+                for (auto word:input.blocks) {
+                    block = readString(*input.file);
+                    BinaryReader reader(block.data(), block.data() + block.size());
+                    gramPath.assign(1, word);
+                    mergeGram(reader, input.words, gramPath, n, *runs_);
+                }
+            } else {
+                for (const auto &word:input.loaded) {
+                    block.clear();
+                    word.second->toBinary(block);
+                    BinaryReader reader(block.data(), block.data() + block.size());
+                    gramPath.assign(1, input.words[word.first]);
+                    mergeGram(reader, input.words, gramPath, n, *runs_);
+                }
+            }
+
+            // Done with this input
+            input = Input{};
+        }
+    } catch (const std::exception &e) {
+        std::cerr << "Error merging dictionaries! " << e.what() << std::endl;
+        runs_.reset();
+        return;
+    }
+
+    if (writeRuns(path)) {
+        std::cout << "Merged!" << std::endl;
+    }
+}
+
+/**
+ * Merge the sorted runs into a binary dictionary at path, written aside then renamed.
+ */
+bool Dictionary::writeRuns(const std::string &path) {
+    std::string               header{};
+    std::vector<const Word *> words = writeBinaryHeader(header, snapshotId());
+
+    const std::string tempPath = path + ".tmp";
+    bool              written;
+    {
+        std::ofstream output(tempPath, std::ios::binary);
+        output.write(header.data(), header.size());
+        written = runs_->merge(output, words.size());
+        output.close();
+        written = written && output;
+    }
+    runs_.reset();
+
+    if (!written || std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        std::cerr << "Error writing dictionary!" << std::endl;
+        return false;
+    }
+    return true;
 }
 
-void Dictionary::save(const std::string &path) const {
+void Dictionary::save(const std::string &path) {
     std::cout << "Saving dictionary to: " << path << std::endl;
 
+    // New snapshot id, the journal of the previous snapshot won't be replayed over this one
+    const std::string id = snapshotId();
+
+    // Files hold actual counts
+    rescaleCounts();
+    remapIds();
+    indexWords();
+
+    // Write aside then rename, so that a crash never leaves a partial dictionary
+    const std::string tempPath = path + ".tmp";
+    bool              isJson   = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    if (!(isJson ? writeJson(tempPath, id) : writeBinary(tempPath, id))
+        || std::rename(tempPath.c_str(), path.c_str()) != 0) {
+        std::cerr << "Error writing dictionary!" << std::endl;
+        return;
+    }
+
+    // Start a new journal for the snapshot
+    this->path   = path;
+    snapshotSize = fileSize(path);
+    journal.open(Journal::pathFor(path), id, true);
+    journalWeight_ = 1;
+
+    std::cout << "Saved!" << std::endl;
+}
+
+bool Dictionary::writeJson(const std::string &path, const std::string &id) const {
     Json::Value root{};
 
-    root["n"]     = static_cast<Json::UInt64>(n);
-    root["words"] = Json::Value(Json::arrayValue);
+    root["n"]       = static_cast<Json::UInt64>(n);
+    root["journal"] = id;
+    root["words"]   = Json::Value(Json::arrayValue);
     for (auto &word:wordMap) {
         root["words"].append(word.second->toJson());
     }
@@ -186,86 +824,341 @@ void Dictionary::save(const std::string &path) const {
     std::unique_ptr<Json::StreamWriter> writer(builder.newStreamWriter());
     std::ofstream                       output(path);
     writer->write(root, &output);
+    return static_cast<bool>(output);
+}
 
-    std::cout << "Saved!" << std::endl;
+/**
+ * Header and word table of the binary format, returns the words in the order of their blocks.
+ */
+std::vector<const Word *> Dictionary::writeBinaryHeader(std::string &out, const std::string &id) const {
+    std::vector<const Word *> words{};
+    for (const auto &word:wordMap) {
+        words.push_back(word.second.get());
+    }
+    std::sort(
+        words.begin(), words.end(),
+        [](const Word *a, const Word *b) {
+            return a->getId() < b->getId();
+        }
+    );
+
+    out += binaryMagic;
+    writeVarint(out, binaryVersion);
+    writeVarint(out, n);
+    writeString(out, id);
+    writeVarint(out, words.size());
+
+    unsigned long previousId = 0;
+    for (const auto &word:words) {
+        writeVarint(out, word->getId() - previousId);
+        previousId = word->getId();
+        writeString(out, word->getInputText());
+        writeString(out, word->getOutputText());
+    }
+
+    return words;
+}
+
+bool Dictionary::writeBinary(const std::string &path, const std::string &id) const {
+    std::string               out{};
+    std::vector<const Word *> words = writeBinaryHeader(out, id);
+
+    std::string block{};
+    for (const auto &word:words) {
+        block.clear();
+        word->toBinary(block);
+        writeString(out, block);
+    }
+
+    std::ofstream output(path, std::ios::binary);
+    output.write(out.data(), out.size());
+    return static_cast<bool>(output);
+}
+
+/**
+ * Fold the journal back into the dictionary file once it outgrows it,
+ * so the cost of rewriting the snapshot stays proportional to what was learned.
+ */
+void Dictionary::compactJournal() {
+    if (journal.isOpen() && journal.size() > snapshotSize) {
+        std::cout << "Compacting journal into " << path << std::endl;
+        save(path);
+    }
+}
+
+/**
+ * Reassign word ids by descending frequency and rebuild the grams accordingly.
+ * Ids otherwise follow first-seen order. Frequent words get small ids, so the children of a
+ * gram are walked most probable first when sampling and get the shortest varints when saved.
+ */
+void Dictionary::remapIds() {
+    if (runs_) {
+        // Runs on disk refer to the current ids
+        return;
+    }
+
+    std::vector<Word *> words{};
+    words.reserve(wordMap.size());
+    for (auto &word:wordMap) {
+        words.push_back(word.second.get());
+    }
+    std::sort(
+        words.begin(), words.end(),
+        [](const Word *a, const Word *b) {
+            unsigned long countA = a->getGram()->getCount();
+            unsigned long countB = b->getGram()->getCount();
+            return countA != countB ? countA > countB : a->getId() < b->getId();
+        }
+    );
+
+    for (unsigned long id = 0; id < words.size(); ++id) {
+        words[id]->setId(id);
+    }
+    idCounter = words.size() - 1;
+    ++idsVersion_;
+
+    parallelFor(
+        words.size(),
+        [&words](unsigned long i) {
+            words[i]->getGram()->remapIds();
+        }
+    );
+}
+
+/**
+ * Freeze the vocabulary into a perfect hash, used by findWord until a new word is ingested.
+ */
+void Dictionary::indexWords() {
+    std::vector<std::pair<std::string, const Word *>> entries{};
+    entries.reserve(wordMap.size());
+    for (const auto &word:wordMap) {
+        entries.emplace_back(word.first, word.second.get());
+    }
+    if (!wordIndex.build(entries)) {
+        std::cerr << Color::FG_RED << "Could not index words, using the word map" << Color::FG_DEFAULT << std::endl;
+    } else {
+        std::cout << "    Indexed " << wordIndex.size() << " words (" << wordIndex.bitsPerKey() << " bits/word)" << std::endl;
+    }
+}
+
+const Word *Dictionary::findWord(const std::string &text) const {
+    if (!wordIndex.empty()) {
+        return wordIndex.find(text);
+    }
+    auto search = wordMap.find(text);
+    return search != wordMap.end() ? search->second.get() : nullptr;
+}
+
+unsigned long Dictionary::fileSize(const std::string &path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    return file ? static_cast<unsigned long>(file.tellg()) : 0;
 }
 
 void Dictionary::input(const std::string &text) {
     std::vector<std::string> words = Parser::parseChunk(text, debug_);
-    ingest(words);
+    ingest(words, inputWeight_);
     updateProbabilities();
+    compactJournal();
 }
 
-void Dictionary::ingest(std::vector<std::string> &words, bool doUpdateProbabilities) {
-    // Stack of markers to complete before ending the sentence
-    std::stack<Word *>  markerStack{};
-    std::vector<Word *> sentenceWords;
-
-    std::string lastWord;
+void Dictionary::ingest(std::vector<std::string> &words, double weight, bool doUpdateProbabilities) {
+    TokenizedText text{};
+    text.weight = weight;
+    tokenize(words, text);
+    ingest(text, doUpdateProbabilities);
+}
 
-    for (const auto &wordString:words) {
-        if (markerStack.empty()) {
-            markerStack.push(beginSentence);
-            sentenceWords.push_back(beginSentence);
+/**
+ * Find or create the word, safe to call from several threads. Created words are only indexed,
+ * adoptWords moves them into wordMap.
+ */
+Word *Dictionary::internWord(const std::string &text) {
+    return vocabulary.intern(
+        text,
+        [this, &text]() {
+            std::unique_ptr<Word>       w    = std::make_unique<Word>(++idCounter, text);
+            Word                        *word = w.get();
+            std::lock_guard<std::mutex> lock(createdWordsMutex);
+            createdWords.push_back(std::move(w));
+            return word;
         }
+    );
+}
+
+/**
+ * Move the words created by internWord into wordMap, from the ingesting thread.
+ */
+void Dictionary::adoptWords() {
+    std::lock_guard<std::mutex> lock(createdWordsMutex);
+    if (createdWords.empty()) {
+        return;
+    }
+    for (auto &word:createdWords) {
+        wordMap[word->getInputText()] = std::move(word);
+    }
+    createdWords.clear();
+    wordIndex.clear();
+}
+
+void Dictionary::indexVocabulary() {
+    vocabulary.clear();
+    for (const auto &word:wordMap) {
+        Word *w = word.second.get();
+        vocabulary.intern(
+            word.first,
+            [w]() {
+                return w;
+            }
+        );
+    }
+}
 
-        Word *word;
-        auto search = wordMap.find(wordString);
-        if (search == wordMap.end()) {
-            unsigned long         id = ++idCounter;
-            std::unique_ptr<Word> w  = std::make_unique<Word>(id, wordString);
-            word = w.get();
-            wordMap[wordString] = std::move(w);
+/**
+ * Intern the words of a parsed chunk and cut them into sentences, appended to text.
+ * Safe to call from several threads, each with its own text.
+ */
+void Dictionary::tokenize(const std::vector<std::string> &words, TokenizedText &text) {
+    const bool journaling = journal.isOpen();
+
+    // Stack of markers to complete before ending the sentence
+    std::vector<Word *> markerStack{};
+    unsigned long       sentenceStart = text.words.size();
+
+    // Keep the sentence unless it is empty, from <s> to </s> with nothing in between.
+    // Its record holds the words in between, which tokenize back into the same sentence.
+    auto finishSentence = [&text, &sentenceStart, journaling]() {
+        if (text.words.size() - sentenceStart > 2) {
+            text.ends.push_back(static_cast<uint32_t>(text.words.size()));
+            if (journaling) {
+                for (unsigned long i = sentenceStart + 1; i < text.words.size() - 1; ++i) {
+                    if (i > sentenceStart + 1) {
+                        text.records += ' ';
+                    }
+                    text.records += text.words[i]->getInputText();
+                }
+                text.records += '\n';
+                text.recordEnds.push_back(text.records.size());
+            }
         } else {
-            word = search->second.get();
+            text.words.resize(sentenceStart);
         }
+        sentenceStart = text.words.size();
+    };
 
-        sentenceWords.push_back(word);
+    for (const auto &wordString:words) {
+        Word *word = internWord(wordString);
 
-        if (markerStack.size() == 1 && (wordString == "." || wordString == "!" || wordString == "?")) {
-            // A sentence was finished, analyse it
-            sentenceWords.push_back(endSentence);
+        if (markerStack.empty()) {
+            markerStack.push_back(beginSentence);
+            text.words.push_back(beginSentence);
+        }
 
-            ingestSentence(sentenceWords, doUpdateProbabilities);
+        text.words.push_back(word);
 
-            sentenceWords.clear();
-            std::stack<Word *>().swap(markerStack);
+        if (markerStack.size() == 1 && wordString.size() == 1 && (wordString[0] == '.' || wordString[0] == '!' || wordString[0] == '?')) {
+            // A sentence was finished
+            text.words.push_back(endSentence);
+            finishSentence();
+            markerStack.clear();
 
         } else if (word->isBeginMarker()) {
-            markerStack.push(word);
-        } else if (word->getId() == markerStack.top()->getEndMarker()->getId()) {
-            markerStack.pop();
+            markerStack.push_back(word);
+        } else if (word == markerStack.back()->getEndMarker()) {
+            markerStack.pop_back();
         }
-
-        lastWord = word->getInputText();
     }
 
-    if (!markerStack.empty() && !sentenceWords.empty()) {
+    if (!markerStack.empty()) {
         // Close missing markers from text, we don't want to leave them open for the ingestion
         while (!markerStack.empty()) {
-            sentenceWords.push_back(const_cast<Word *>(markerStack.top()->getEndMarker()));
-            markerStack.pop();
+            text.words.push_back(const_cast<Word *>(markerStack.back()->getEndMarker()));
+            markerStack.pop_back();
         }
+        finishSentence();
+    }
+}
 
-        ingestSentence(sentenceWords, doUpdateProbabilities);
+/**
+ * Fingerprint of a sentence for deduplication.
+ * Words are hashed by address, which unlike ids does not change when ids are remapped.
+ */
+static uint64_t sentenceKey(std::vector<Word *>::const_iterator begin, std::vector<Word *>::const_iterator end) {
+    uint64_t key = 0;
+    for (; begin != end; ++begin) {
+        key = (key ^ reinterpret_cast<uintptr_t>(*begin)) * 0x9E3779B97F4A7C15ULL;
+        key ^= key >> 29;
+    }
+    return key;
+}
 
-    } else if (!markerStack.empty()) {
-        std::cerr << Color::FG_RED << "Marker stack left non-empty but sentence has zero length"
-                  << Color::FG_DEFAULT
-                  << std::endl;
-    } else if (!sentenceWords.empty()) {
-        std::cerr << Color::FG_RED << "Sentence left non-empty but marker stack has zero length"
-                  << Color::FG_DEFAULT
-                  << std::endl;
+/**
+ * Count tokenized text, from the ingesting thread. With deduplication on, copies of a sentence past
+ * dedupCopies_ are skipped. Fingerprints live in a count-min sketch, so memory is bounded whatever
+ * the corpus size, at the cost of rarely taking a sentence for a copy of another.
+ * Only the sentences counted are journaled, so that replaying the journal counts the same.
+ */
+void Dictionary::ingest(const TokenizedText &text, bool doUpdateProbabilities) {
+    adoptWords();
+    const bool journaling = !text.recordEnds.empty();
+    if (journaling && text.weight != journalWeight_) {
+        journal.append(Journal::directive("weight", text.weight));
+        journalWeight_ = text.weight;
+    }
+
+    // Records of the counted sentences, only gathered once a sentence is skipped
+    std::string kept{};
+    bool        skipping = false;
+
+    std::vector<Word *> sentenceWords{};
+    uint32_t            begin = 0;
+    for (unsigned long i = 0; i < text.ends.size(); ++i) {
+        auto first = text.words.begin() + begin;
+        auto last  = text.words.begin() + text.ends[i];
+        begin = text.ends[i];
+
+        size_t recordBegin = journaling && i > 0 ? text.recordEnds[i - 1] : 0;
+        if (dedup_) {
+            ++dedupSentences_;
+            if (dedup_->add(sentenceKey(first, last)) > dedupCopies_) {
+                ++dedupSkipped_;
+                if (journaling && !skipping) {
+                    kept.assign(text.records, 0, recordBegin);
+                }
+                skipping = true;
+                continue;
+            }
+        }
+        if (journaling && skipping) {
+            kept.append(text.records, recordBegin, text.recordEnds[i] - recordBegin);
+        }
+
+        sentenceWords.assign(first, last);
+        ingestSentence(sentenceWords, scaledCount(text.weight), doUpdateProbabilities);
     }
+
+    journal.append(skipping ? kept : text.records);
 }
 
-void Dictionary::ingestSentence(std::vector<Word *> &sentenceWords, bool doUpdateProbabilities) {
-    // Forget possible empty sentences
-    if (sentenceWords.size() > 2) {
-        // Do not loop to endSentence, not necessary
-        for (unsigned long i = 0; i < sentenceWords.size(); ++i) {
-            sentenceWords[i]->updateGraph(sentenceWords, i, n);
+/**
+ * Count a sentence count times, in units of the current count scale (see scaledCount).
+ */
+void Dictionary::ingestSentence(std::vector<Word *> &sentenceWords, unsigned long count, bool doUpdateProbabilities) {
+    // Forget possible empty sentences, and those too light to count yet
+    if (sentenceWords.size() > 2 && count > 0) {
+        if (runs_) {
+            // Counted on disk
+            runs_->add(sentenceWords, count);
+        } else {
+            // Back to front, so that every new gram finds its suffix gram already in place
+            if (updateFixed_ != nullptr && !sketch_) {
+                for (unsigned long i = sentenceWords.size(); i-- > 0;) {
+                    (sentenceWords[i]->getGram()->*updateFixed_)(sentenceWords, i, count);
+                }
+            } else {
+                for (unsigned long i = sentenceWords.size(); i-- > 0;) {
+                    sentenceWords[i]->updateGraph(sentenceWords, i, n, count, sketch_.get(), sketchThreshold_);
+                }
+            }
         }
     }
 
@@ -276,32 +1169,202 @@ void Dictionary::ingestSentence(std::vector<Word *> &sentenceWords, bool doUpdat
 }
 
 void Dictionary::updateProbabilities() {
-    unsigned long count = 0;
+    using Task = std::pair<Gram *, unsigned long>;
+
+    unsigned long     count = 0;
+    std::vector<Task> tasks{};
 
     for (auto &word:wordMap) {
         count += word.second->getGram()->getCount();
     }
 
+    // Each word's grams are independent once the total is known.
+    // Fanout is very skewed (<s> and punctuation are followed by almost everything),
+    // so big subtrees are split into tasks and started first.
+    for (auto &word:wordMap) {
+        tasks.emplace_back(word.second->getGram(), count);
+    }
+    std::sort(
+        tasks.begin(), tasks.end(),
+        [](const Task &a, const Task &b) {
+            return a.first->size() > b.first->size();
+        }
+    );
+
+    workSteal<Task>(
+        tasks,
+        [](Task &task, const std::function<void(Task)> &spawn) {
+            task.first->computeProbability(
+                task.second,
+                [&spawn](Gram *gram, unsigned long total) {
+                    spawn(Task{gram, total});
+                }
+            );
+        }
+    );
+}
+
+/**
+ * Count of an occurrence of the given weight at the current count scale. The fraction left over is
+ * carried to the next occurrence, so that a weight of 0.25 counts one sentence out of four.
+ */
+unsigned long Dictionary::scaledCount(double weight) {
+    double        count = weight / countScale_ + countCarry_;
+    unsigned long whole = static_cast<unsigned long>(count);
+    countCarry_ = count - whole;
+    return whole;
+}
+
+/**
+ * Age what was learned so far: its counts are multiplied by factor, so that what is ingested next
+ * weighs relatively more. Probabilities are ratios of counts, so they do not change.
+ * Nothing is touched but the count scale, new occurrences are counted in its units (see scaledCount).
+ * When it gets below minCountScale, counts are rescaled and the grams left under one are pruned,
+ * so that a dictionary decayed as it keeps learning stays bounded.
+ */
+void Dictionary::decay(double factor) {
+    if (!(factor > 0 && factor <= 1)) {
+        std::cerr << "Decay factor must be between 0 and 1" << std::endl;
+        return;
+    }
+    if (runs_) {
+        std::cerr << "Can't decay a dictionary being built" << std::endl;
+        return;
+    }
+
+    journal.append(Journal::directive("decay", factor));
+    countScale_ *= factor;
+    if (countScale_ < minCountScale) {
+        rescaleCounts();
+    }
+}
+
+/**
+ * Bring stored counts back to actual counts, pruning the grams whose count rounds to zero and the
+ * words left without any.
+ */
+void Dictionary::rescaleCounts() {
+    if (countScale_ == 1) {
+        return;
+    }
+
+    std::vector<Word *> words{};
+    words.reserve(wordMap.size());
     for (auto &word:wordMap) {
-        word.second->updateProbabilities(count);
+        words.push_back(word.second.get());
+    }
+
+    const double               scale = countScale_;
+    std::atomic<unsigned long> pruned{0};
+    parallelFor(
+        words.size(),
+        [&words, &pruned, scale](unsigned long i) {
+            pruned += words[i]->getGram()->rescale(scale);
+        }
+    );
+    // Pruned grams could be the suffix of grams of other words
+    parallelFor(
+        words.size(),
+        [&words](unsigned long i) {
+            words[i]->linkSuffixes();
+        }
+    );
+
+    countScale_ = 1;
+    countCarry_ *= scale;
+    if (pruned > 0) {
+        std::cout << "    Pruned " << pruned << " grams" << std::endl;
     }
+
+    // No gram follows a word counted down to zero, as none can be counted more than its words
+    unsigned long removed = 0;
+    for (auto word = wordMap.begin(); word != wordMap.end();) {
+        const Gram *gram = word->second->getGram();
+        if (gram->getCount() == 0 && gram->size() == 0 && !word->second->isMarker()) {
+            word->second->setId(std::numeric_limits<unsigned long>::max());
+            retiredWords_.push_back(std::move(word->second));
+            word = wordMap.erase(word);
+            ++removed;
+        } else {
+            ++word;
+        }
+    }
+    if (removed > 0) {
+        std::cout << "    Removed " << removed << " words" << std::endl;
+        indexVocabulary();
+        wordIndex.clear();
+        remapIds();
+    }
+    updateProbabilities();
+}
+
+/**
+ * Pick the unrolled gram walkers when n is one of the common sizes they are compiled for.
+ */
+void Dictionary::selectWalkers() {
+    switch (n) {
+        case 3:
+            updateFixed_  = &Gram::updateFixed<3>;
+            descendFixed_ = &Gram::descendFixed<3>;
+            break;
+        case 4:
+            updateFixed_  = &Gram::updateFixed<4>;
+            descendFixed_ = &Gram::descendFixed<4>;
+            break;
+        default:
+            updateFixed_  = nullptr;
+            descendFixed_ = nullptr;
+    }
+}
+
+/**
+ * Gram of sentence[position..] following word, whose followers are the candidates after the sentence.
+ */
+const Gram *Dictionary::descend(const Word *word, const std::vector<const Word *> &sentence, unsigned long position) const {
+    return (word->getGram()->*descendFixed_)(sentence, position);
+}
+
+/**
+ * Move the context cursor forward by one word, Aho-Corasick style.
+ * Returns the deepest gram usable as a context (depth < n - 1) ending with the word,
+ * falling back through suffix links when the current context has no such continuation.
+ */
+const Gram *Dictionary::advance(const Gram *context, const Word *word) const {
+    while (context != nullptr) {
+        const Gram *gram = context->find(word->getId());
+        if (gram != nullptr) {
+            // Deepest grams have no followers, use their suffix as the context
+            return gram->getDepth() + 1 < n ? gram : gram->getSuffix();
+        }
+        context = context->getSuffix();
+    }
+    return word->getGram();
 }
 
-std::vector<const std::string> Dictionary::nextCandidateWords(std::string seed) const {
-    std::vector<const std::string> results;
+std::vector<std::string> Dictionary::nextCandidateWords(std::string seed) const {
+    std::vector<std::string> results;
     std::vector<const Word *>      sentence{beginSentence};
 
     for (const auto &s:Parser::parseChunk(std::move(seed))) {
-        auto search = wordMap.find(s);
-        if (search == wordMap.end()) {
+        const Word *word = findWord(s);
+        if (word == nullptr) {
             return results;
         }
-        sentence.push_back(search->second.get());
+        sentence.push_back(word);
     }
 
     unsigned long start = sentence.size() > n - 1 ? sentence.size() - (n - 1) : 0;
 
     for (unsigned long i = start; i < sentence.size(); ++i) {
+        if (descendFixed_ != nullptr) {
+            const Gram *gram = descend(sentence[i], sentence, i + 1);
+            if (gram != nullptr) {
+                for (auto c:gram->candidates({}, 0)) {
+                    results.push_back(c->getWord()->getOutputText());
+                }
+            }
+            continue;
+        }
         for (auto c:sentence[i]->candidates(sentence, i + 1)) {
             results.push_back(c->getOutputText());
         }
@@ -314,18 +1377,25 @@ std::string Dictionary::nextMostProbableWord(std::string seed) const {
     std::vector<const Word *> sentence{beginSentence};
 
     for (const auto &s:Parser::parseChunk(std::move(seed))) {
-        auto search = wordMap.find(s);
-        if (search == wordMap.end()) {
+        const Word *word = findWord(s);
+        if (word == nullptr) {
             return "";
         }
-        sentence.push_back(search->second.get());
+        sentence.push_back(word);
     }
 
     const Word    *newWord = nullptr;
     unsigned long start    = sentence.size() > n - 1 ? sentence.size() - (n - 1) : 0;
 
     for (unsigned long i = start; i < sentence.size(); ++i) {
-        const Word *w = sentence[i]->mostProbable(sentence, i + 1);
+        const Word *w;
+        if (descendFixed_ != nullptr) {
+            const Gram *gram = descend(sentence[i], sentence, i + 1);
+            const Gram *g    = gram ? gram->mostProbable({}, 0) : nullptr;
+            w = g ? g->getWord() : nullptr;
+        } else {
+            w = sentence[i]->mostProbable(sentence, i + 1);
+        }
         if (w != nullptr) {
             newWord = w;
             break;
@@ -335,21 +1405,76 @@ std::string Dictionary::nextMostProbableWord(std::string seed) const {
     return newWord ? newWord->getOutputText() : "";
 }
 
+void Dictionary::updateTopic(Topic &topic, const std::string &text) const {
+    topic.reorder(idsVersion_);
+    topic.decay();
+
+    if (text.empty()) {
+        return;
+    }
+
+    std::vector<std::string> topicStrings = Parser::parseChunk(text);
+
+    for (const auto &wordString:topicStrings) {
+        const Word *word = findWord(wordString);
+        if (word != nullptr && !word->isMarker()) {
+            topic.add(word);
+        }
+    }
+
+    if (debug_) {
+        std::cout << "Raw topic: (" << topicStrings.size() << "): " << Color::FG_DARK_GRAY;
+        for (const auto &w:topicStrings) {
+            std::cout << w << " ";
+        }
+        std::cout << Color::FG_DEFAULT << std::endl;
+        std::cout << "Sentence topic: " << Color::FG_DARK_GRAY << topic.toString() << Color::FG_DEFAULT << std::endl;
+    }
+}
+
 std::string Dictionary::generate(std::string topic, std::string seed) const {
-    // Stack of markers to complete before ending the sentence
-    std::stack<const Word *> markerStack{};
+    Topic topicWords{};
+    updateTopic(topicWords, topic);
+    return generate(topicWords, std::move(seed));
+}
+
+std::string Dictionary::generate(const Topic &topicWords, std::string seed) const {
+    std::string sentenceText{};
+    generate(topicWords, seed, sentenceText);
+    return sentenceText;
+}
+
+Dictionary::Scratch &Dictionary::scratch() {
+    static thread_local Scratch scratch{};
+    return scratch;
+}
+
+/**
+ * Generate a sentence into sentenceText, reusing its storage. Without a seed, beam search or best of,
+ * this does not allocate once the buffers of the thread have grown to the sentence sizes.
+ */
+void Dictionary::generate(const Topic &topicWords, const std::string &seed, std::string &sentenceText) const {
+    // Words were renumbered since the topic was last updated (ingesting or saving remaps ids),
+    // its entries must be sorted by the current ids to be matched against the grams
+    if (!topicWords.empty() && topicWords.getIdsVersion() != idsVersion_) {
+        Topic current = topicWords;
+        current.reorder(idsVersion_);
+        generate(current, seed, sentenceText);
+        return;
+    }
 
     // Sentence, started by beginSentence marker
-    std::vector<const Word *> sentence{beginSentence};
+    std::vector<const Word *> &sentence = scratch().seed;
+    sentence.assign(1, beginSentence);
 
     // Pre seed
     if (!seed.empty()) {
         std::vector<std::string> seedStrings = Parser::parseChunk(seed);
 
         for (const auto &s:seedStrings) {
-            auto search = wordMap.find(s);
-            if (search != wordMap.end()) {
-                sentence.push_back(search->second.get());
+            const Word *word = findWord(s);
+            if (word != nullptr) {
+                sentence.push_back(word);
             }
         }
 
@@ -367,35 +1492,66 @@ std::string Dictionary::generate(std::string topic, std::string seed) const {
         }
     }
 
-    // Topic
-    std::vector<const Word *> topicWords{};
-    if (!topic.empty()) {
-        std::vector<std::string> topicStrings = Parser::parseChunk(topic);
+    std::vector<const Word *> best{};
 
-        for (const auto &wordString:topicStrings) {
-            auto search = wordMap.find(wordString);
-            if (search != wordMap.end()) {
-                auto word = search->second.get();
-                if (!word->isMarker()) {
-                    topicWords.push_back(word);
-                }
+    if (beamWidth_ > 1) {
+        best = beamSearch(sentence, topicWords);
+    }
+
+    if (best.empty() && bestOf_ > 1) {
+        // Sample candidates in parallel, at most one thread per hardware thread, keep the best ranked one
+        std::vector<std::vector<const Word *>> candidates(bestOf_);
+        parallelFor(
+            bestOf_,
+            [this, &sentence, &topicWords, &candidates](unsigned long i) {
+                candidates[i] = walk(sentence, topicWords, false);
             }
-        }
+        );
 
-        if (debug_) {
-            std::cout << "Raw topic: (" << topicStrings.size() << "): " << Color::FG_DARK_GRAY;
-            for (const auto &w:topicStrings) {
-                std::cout << w << " ";
+        double bestRank = -INFINITY;
+        for (auto &candidate:candidates) {
+            double candidateRank = rank(candidate, sentence.size(), topicWords);
+            if (debug_) {
+                std::cout << Color::FG_DARK_GRAY << "Candidate (" << Color::FG_MAGENTA << candidateRank
+                          << Color::FG_DARK_GRAY << "): " << render(candidate) << Color::FG_DEFAULT << std::endl;
             }
-            std::cout << Color::FG_DEFAULT << std::endl;
-            std::cout << "Sentence topic: (" << topicWords.size() << "): " << Color::FG_DARK_GRAY;
-            for (const auto &w:topicWords) {
-                std::cout << w->getInputText() << " ";
+            if (best.empty() || candidateRank > bestRank) {
+                best     = std::move(candidate);
+                bestRank = candidateRank;
             }
-            std::cout << Color::FG_DEFAULT << std::endl;
         }
     }
 
+    const std::vector<const Word *> &result = best.empty() ? walk(sentence, topicWords, debug_) : best;
+
+    if (debug_) {
+        std::cout << Color::FG_DARK_GRAY << "Raw sentence (" << Color::FG_MAGENTA << std::to_string(rank(result, sentence.size(), topicWords))
+                  << Color::FG_DARK_GRAY << "): ";
+        for (const auto &w:result) {
+            std::cout << w->getInputText() << " ";
+        }
+        std::cout << Color::FG_DEFAULT << std::endl;
+    }
+
+    render(result, sentenceText);
+}
+
+/**
+ * Random walk from the seed sentence until every marker is closed, backing off when stuck.
+ * The sentence is built in the scratch buffers of the thread, valid until its next walk.
+ */
+const std::vector<const Word *> &Dictionary::walk(const std::vector<const Word *> &seed, const Topic &topicWords, bool debug) const {
+    Scratch &buffers = scratch();
+
+    std::vector<const Word *> &sentence = buffers.sentence;
+    sentence.assign(seed.begin(), seed.end());
+
+    // Stack of markers to complete before ending the sentence
+    MarkerStack &markerStack = buffers.markerStack;
+    while (!markerStack.empty()) {
+        markerStack.pop();
+    }
+
     // Add current sentence markers to the stack
     for (const auto &word:sentence) {
         if (word->isBeginMarker()) {
@@ -403,22 +1559,27 @@ std::string Dictionary::generate(std::string topic, std::string seed) const {
         }
     }
 
+    // Context cursor after each word of the sentence, popped along with the words when backing off
+    std::vector<const Gram *> &contexts = buffers.contexts;
+    contexts.clear();
+    for (const auto &word:sentence) {
+        contexts.push_back(advance(contexts.empty() ? nullptr : contexts.back(), word));
+    }
+
     const unsigned long seedSize       = sentence.size();
     unsigned long       retryPosition  = seedSize;
     unsigned long       backOffCount   = 0;
     bool                finishSentence = false;
 
-    double score = -1;
-
     const Word *lastWord = nullptr;
     while (!markerStack.empty()) {
 
-        if (debug_) {
+        if (debug) {
             std::cout << "Marker stack (size: " << markerStack.size() << "): " << markerStack.top()->getInputText() << std::endl;
         }
 
         do {
-            if (debug_) {
+            if (debug) {
                 std::cout << "  Searching new word for sentence: " << Color::FG_LIGHT_GRAY;
                 for (const auto &w:sentence) {
                     std::cout << w->getInputText() << " ";
@@ -427,32 +1588,37 @@ std::string Dictionary::generate(std::string topic, std::string seed) const {
             }
 
             // Try to find n-gram first then (n-1)-gram etc... until we find something
-            const Word    *newWord = nullptr;
-            unsigned long start    = sentence.size() > n - 1 ? sentence.size() - (n - 1) : 0;
+            const Word *newWord = nullptr;
 
-            for (unsigned long i = start; i < sentence.size(); ++i) {
-                if (debug_) {
+            for (const Gram *context = contexts.back(); context != nullptr; context = context->getSuffix()) {
+                if (debug) {
                     std::cout << Color::FG_LIGHT_GRAY << "    From: ";
-                    for (unsigned long j = i; j < sentence.size(); ++j) {
+                    for (unsigned long j = sentence.size() - context->getDepth() - 1; j < sentence.size(); ++j) {
                         std::cout << sentence[j]->getInputText() << " ";
                     }
                     std::cout << Color::FG_DEFAULT << std::endl;
                 }
 
-                const Gram *nextGram = sentence[i]->nextGram(sentence, i + 1, markerStack, topicWords, finishSentence, debug_);
+                const Gram *nextGram = context->sample(markerStack, topicWords, finishSentence, debug);
                 if (nextGram != nullptr) {
                     newWord = nextGram->getWord();
-                    score   = (score == -1) ? nextGram->getProbability() : (score + nextGram->getProbability()) / 2;
                     break;
                 }
             }
 
+            // Grams pruned by decay can loop without ever reaching the end marker, close it past the
+            // length beam search and blending stop at
+            if (newWord != nullptr && sentence.size() >= maxSentenceLength * 4) {
+                newWord = markerStack.top()->getEndMarker();
+            }
+
             if (newWord) {
-                if (debug_) {
+                if (debug) {
                     std::cout << "  Found: " << Color::FG_GREEN << newWord->getInputText() << Color::FG_DEFAULT << std::endl;
                 }
 
                 sentence.push_back(newWord);
+                contexts.push_back(advance(contexts.back(), newWord));
 
                 // If found word is a marker add it to the marker stack
                 if (newWord->isBeginMarker()) {
@@ -466,19 +1632,19 @@ std::string Dictionary::generate(std::string topic, std::string seed) const {
                 }
 
                 // If we are past the max sentence size, finish as soon as possible
-                if (sentence.size() > 10) {
+                if (sentence.size() > maxSentenceLength) {
                     finishSentence = true;
                 }
 
             } else {
-                if (debug_) {
+                if (debug) {
                     std::cout << Color::FG_RED << "  Nothing found" << Color::FG_DEFAULT << std::endl;
                 }
 
                 ++backOffCount;
                 long backOffPosition = static_cast<long>(retryPosition) - static_cast<long>(backOffCount);
                 if (backOffPosition >= static_cast<long>(seedSize)) {
-                    if (debug_) {
+                    if (debug) {
                         std::cout << Color::FG_BLUE << "  Backing off to position " << (retryPosition - backOffCount)
                                   << "/" << sentence.size() << Color::FG_DEFAULT << std::endl;
                     }
@@ -488,11 +1654,12 @@ std::string Dictionary::generate(std::string topic, std::string seed) const {
                     for (unsigned long i = 0; i < removeCount; ++i) {
                         const Word *w = sentence.back();
                         sentence.pop_back();
+                        contexts.pop_back();
                         // Remove from stack if it was a marker
                         if (w->getId() == markerStack.top()->getId()) {
                             markerStack.pop();
 
-                            if (debug_) {
+                            if (debug) {
                                 std::cout << Color::FG_BLUE << "  Removing " << w->getInputText() << " from stack"
                                           << Color::FG_DEFAULT << std::endl;
                             }
@@ -503,7 +1670,7 @@ std::string Dictionary::generate(std::string topic, std::string seed) const {
                     continue;
 
                 } else {
-                    if (debug_) {
+                    if (debug) {
                         std::cout << Color::FG_RED << "  Can't back off past seed, giving up!" << Color::FG_DEFAULT << std::endl;
                     }
                     break;
@@ -514,7 +1681,7 @@ std::string Dictionary::generate(std::string topic, std::string seed) const {
 
         } while (lastWord == nullptr || lastWord->getId() != markerStack.top()->getEndMarker()->getId());
 
-        if (debug_) {
+        if (debug) {
             std::cout << "Popping marker stack: " << Color::FG_LIGHT_GRAY << markerStack.top()->getInputText() << Color::FG_DEFAULT << std::endl;
         }
 
@@ -522,31 +1689,344 @@ std::string Dictionary::generate(std::string topic, std::string seed) const {
 
     } // end while markerStack > 0
 
-    if (debug_) {
-        std::cout << Color::FG_DARK_GRAY << "Raw sentence (" << Color::FG_MAGENTA << std::to_string(score) << Color::FG_DARK_GRAY << "): ";
-        for (const auto &w:sentence) {
-            std::cout << w->getInputText() << " ";
+    return sentence;
+}
+
+namespace {
+    /**
+     * Beam search hypothesis, hypotheses sharing a prefix share its nodes (and context cursors).
+     */
+    struct Hypothesis {
+        std::shared_ptr<const Hypothesis> parent;
+        const Word                        *word;
+        const Gram                        *context;
+        const Hypothesis                  *marker; // Innermost open marker, nullptr when the sentence is closed
+        const Hypothesis                  *outerMarker; // Marker that was open before this one, for marker hypotheses
+        double                            logProbability;
+        unsigned long                     length;
+    };
+
+    struct Expansion {
+        std::shared_ptr<const Hypothesis> parent;
+        const Gram                        *gram;
+        double                            logProbability;
+    };
+}
+
+/**
+ * Deterministic beam search from the seed sentence, keeps the beamWidth_ best hypotheses at each step.
+ * Returns an empty sentence if no hypothesis could be completed.
+ */
+std::vector<const Word *> Dictionary::beamSearch(const std::vector<const Word *> &seed, const Topic &topicWords) const {
+    auto extend = [this](const std::shared_ptr<const Hypothesis> &parent, const Word *word, double logProbability) {
+        const Hypothesis *marker      = parent ? parent->marker : nullptr;
+        const Hypothesis *outerMarker = nullptr;
+        auto             hypothesis   = std::make_shared<Hypothesis>(
+            Hypothesis{parent, word, advance(parent ? parent->context : nullptr, word), nullptr, nullptr, logProbability, parent ? parent->length + 1 : 1}
+        );
+        if (word->isBeginMarker()) {
+            outerMarker = marker;
+            marker      = hypothesis.get();
+        } else if (marker != nullptr && word->getId() == marker->word->getEndMarker()->getId()) {
+            marker = marker->outerMarker;
         }
-        std::cout << Color::FG_DEFAULT << std::endl;
+        hypothesis->marker      = marker;
+        hypothesis->outerMarker = outerMarker;
+        return std::shared_ptr<const Hypothesis>(hypothesis);
+    };
+
+    std::shared_ptr<const Hypothesis> root{nullptr};
+    for (const auto &word:seed) {
+        root = extend(root, word, 0);
+    }
+
+    // Expand a hypothesis with the allowed followers of its deepest context that has some
+    auto expand = [this](const std::shared_ptr<const Hypothesis> &hypothesis) {
+        std::vector<Expansion> expansions{};
+        const Word             *top           = hypothesis->marker->word;
+        bool                   finishSentence = hypothesis->length > maxSentenceLength;
+
+        for (const Gram *context = hypothesis->context; context != nullptr && expansions.empty(); context = context->getSuffix()) {
+            if (finishSentence) {
+                const Gram *closing = context->find(top->getEndMarker()->getId());
+                if (closing != nullptr) {
+                    expansions.push_back(Expansion{hypothesis, closing, hypothesis->logProbability + std::log(closing->getProbability())});
+                    break;
+                }
+            }
+            for (const Gram *gram:context->candidates({}, 0)) {
+                const Word *word = gram->getWord();
+                if ((finishSentence && word->isBeginMarker())
+                    || (word->isBeginMarker() && word->getId() == top->getId())
+                    || (word->isEndMarker() && word->getBeginMarker()->getId() != top->getId())) {
+                    continue;
+                }
+                expansions.push_back(Expansion{hypothesis, gram, hypothesis->logProbability + std::log(gram->getProbability())});
+                // Candidates are sorted by probability, no need to look past the beam width
+                if (expansions.size() >= beamWidth_) {
+                    break;
+                }
+            }
+        }
+        return expansions;
+    };
+
+    std::vector<std::shared_ptr<const Hypothesis>> beam{root};
+    std::vector<std::shared_ptr<const Hypothesis>> finished{};
+
+    // Normalized by length so that short sentences are not favored
+    auto normalized = [&seed](double logProbability, unsigned long length) {
+        return logProbability / std::max(1ul, length - seed.size());
+    };
+
+    for (unsigned long step = 0; step < maxSentenceLength * 4 && !beam.empty() && finished.size() < beamWidth_; ++step) {
+        // Hypotheses are expanded side by side, at most one thread per hardware thread
+        std::vector<std::vector<Expansion>> expanded(beam.size());
+        parallelFor(
+            beam.size(),
+            [&expand, &beam, &expanded](unsigned long i) {
+                expanded[i] = expand(beam[i]);
+            }
+        );
+
+        std::vector<Expansion> expansions{};
+        for (auto &hypothesisExpansions:expanded) {
+            for (auto &expansion:hypothesisExpansions) {
+                expansions.push_back(std::move(expansion));
+            }
+        }
+
+        unsigned long keep = std::min<unsigned long>(beamWidth_, expansions.size());
+        std::partial_sort(
+            expansions.begin(), expansions.begin() + keep, expansions.end(),
+            [&normalized](const Expansion &a, const Expansion &b) {
+                return normalized(a.logProbability, a.parent->length + 1) > normalized(b.logProbability, b.parent->length + 1);
+            }
+        );
+
+        beam.clear();
+        for (unsigned long i = 0; i < keep; ++i) {
+            auto hypothesis = extend(expansions[i].parent, expansions[i].gram->getWord(), expansions[i].logProbability);
+            if (hypothesis->marker == nullptr) {
+                finished.push_back(hypothesis);
+            } else {
+                beam.push_back(hypothesis);
+            }
+        }
+    }
+
+    std::vector<const Word *> best{};
+    double                    bestRank = -INFINITY;
+    for (const auto &hypothesis:finished) {
+        std::vector<const Word *> sentence{};
+        for (const Hypothesis *h = hypothesis.get(); h != nullptr; h = h->parent.get()) {
+            sentence.push_back(h->word);
+        }
+        std::reverse(sentence.begin(), sentence.end());
+
+        double sentenceRank = rank(sentence, seed.size(), topicWords);
+        if (debug_) {
+            std::cout << Color::FG_DARK_GRAY << "Beam (" << Color::FG_MAGENTA << sentenceRank
+                      << Color::FG_DARK_GRAY << "): " << render(sentence) << Color::FG_DEFAULT << std::endl;
+        }
+        if (best.empty() || sentenceRank > bestRank) {
+            best     = std::move(sentence);
+            bestRank = sentenceRank;
+        }
+    }
+
+    return best;
+}
+
+/**
+ * Probability of the word following the context, with the same backoff as generation:
+ * deepest context first, then the unigram.
+ */
+double Dictionary::probability(const Gram *context, const Word *word) const {
+    for (; context != nullptr; context = context->getSuffix()) {
+        const Gram *gram = context->find(word->getId());
+        if (gram != nullptr) {
+            return gram->getProbability();
+        }
+    }
+    return word->getGram()->getProbability();
+}
+
+/**
+ * Rank of a generated sentence: log-probability per generated word, plus the weighted share of topic words covered.
+ */
+double Dictionary::rank(const std::vector<const Word *> &sentence, unsigned long seedSize, const Topic &topicWords) const {
+    const Gram    *context       = nullptr;
+    double        logProbability = 0;
+    unsigned long count          = 0;
+
+    for (unsigned long i = 0; i < sentence.size(); ++i) {
+        if (i >= seedSize) {
+            double p = probability(context, sentence[i]);
+            if (p > 0) {
+                logProbability += std::log(p);
+                ++count;
+            }
+        }
+        context = advance(context, sentence[i]);
+    }
+
+    double result = count > 0 ? logProbability / count : -INFINITY;
+
+    if (topicWeight_ > 0 && !topicWords.empty()) {
+        double covered = 0;
+        for (const auto &entry:topicWords) {
+            if (std::find(sentence.begin() + seedSize, sentence.end(), entry.word) != sentence.end()) {
+                covered += entry.weight;
+            }
+        }
+        result += topicWeight_ * covered / topicWords.total();
     }
 
+    return result;
+}
+
+/**
+ * Join the output texts, making punctuation back into actual punctuation as it goes:
+ * punctuation and closing markers stick to the previous word, opening markers to the next one
+ * and apostrophes to both.
+ */
+std::string Dictionary::render(const std::vector<const Word *> &sentence) const {
     std::string sentenceText{};
+    render(sentence, sentenceText);
+    return sentenceText;
+}
+
+void Dictionary::render(const std::vector<const Word *> &sentence, std::string &sentenceText) const {
+    sentenceText.clear();
+    bool attach = true;
 
     for (const auto &w:sentence) {
-        if (!w->getOutputText().empty()) {
-            sentenceText += w->getOutputText() + " ";
+        const std::string &output = w->getOutputText();
+        if (output.empty()) {
+            continue;
+        }
+
+        bool isApostrophe = output == "'";
+        bool attachLeft   = isApostrophe || w->isEndMarker()
+                            || (output.size() == 1 && std::strchr(".,:;!?", output[0]) != nullptr);
+        if (!attach && !attachLeft) {
+            sentenceText += ' ';
         }
+        sentenceText += output;
+        attach = isApostrophe || w->isBeginMarker();
     }
 
-    std::transform(sentenceText.begin(), sentenceText.begin() + 1, sentenceText.begin(), ::toupper);
+    Text::capitalize(sentenceText);
+}
+
+Score Dictionary::score(const std::string &text) const {
+    Score result{};
+
+    // Stack of markers, used the same way as ingestion to find sentence boundaries
+    std::stack<const Word *> markerStack{};
+    const Gram               *context = nullptr;
 
-    // Make punctuation back into actual punctuation
-    sentenceText = std::regex_replace(sentenceText, std::regex(" ([.,:;!?])"), "$1");
-    sentenceText = std::regex_replace(sentenceText, std::regex(" ([']) "), "$1");
-    sentenceText = std::regex_replace(sentenceText, std::regex("\" (.+?) \""), "\"$1\"");
-    sentenceText = std::regex_replace(sentenceText, std::regex("\\( (.+?) \\)"), "\\($1\\)");
+    auto scoreWord = [this, &result, &context](const Word *word) {
+        double probability = this->probability(context, word);
 
-    return sentenceText;
+        if (probability > 0) {
+            result.add(word->getInputText(), std::log(probability));
+        } else {
+            result.skip(word->getInputText());
+        }
+
+        context = advance(context, word);
+    };
+
+    for (const auto &wordString:Parser::parseChunk(text)) {
+        if (markerStack.empty()) {
+            markerStack.push(beginSentence);
+            context = advance(nullptr, beginSentence);
+        }
+
+        const Word *word = findWord(wordString);
+        if (word == nullptr) {
+            // Unknown word, the context is lost
+            result.skip(wordString);
+            context = nullptr;
+            continue;
+        }
+
+        scoreWord(word);
+
+        if (markerStack.size() == 1 && (wordString == "." || wordString == "!" || wordString == "?")) {
+            scoreWord(endSentence);
+            std::stack<const Word *>().swap(markerStack);
+        } else if (word->isBeginMarker()) {
+            markerStack.push(word);
+        } else if (word->getId() == markerStack.top()->getEndMarker()->getId()) {
+            markerStack.pop();
+        }
+    }
+
+    // Close missing markers, like ingestion does
+    while (!markerStack.empty()) {
+        scoreWord(markerStack.top()->getEndMarker());
+        markerStack.pop();
+    }
+
+    return result;
+}
+
+void Dictionary::scoreFile(const std::string &filePath) const {
+    std::cout << "Scoring text from " << filePath << " ..." << std::endl;
+    auto start = std::chrono::high_resolution_clock::now();
+
+    std::vector<std::string> lines{};
+    {
+        std::ifstream file(filePath, std::ios::binary);
+        if (!file) {
+            std::cerr << "File not found!" << std::endl;
+            return;
+        }
+        std::string line;
+        while (std::getline(file, line)) {
+            if (!line.empty()) {
+                lines.push_back(line);
+            }
+        }
+    }
+
+    // Score blocks of lines in parallel, the dictionary is only read
+    unsigned long numThreads = threadCount();
+    unsigned long blockSize  = (lines.size() + numThreads - 1) / numThreads;
+
+    std::vector<std::future<std::vector<Score>>> pool{};
+    for (unsigned long begin = 0; begin < lines.size(); begin += blockSize) {
+        unsigned long end = std::min(begin + blockSize, lines.size());
+        pool.push_back(
+            std::async(
+                std::launch::async,
+                [this, &lines, begin, end]() {
+                    std::vector<Score> scores{};
+                    for (unsigned long i = begin; i < end; ++i) {
+                        scores.push_back(score(lines[i]));
+                    }
+                    return scores;
+                }
+            )
+        );
+    }
+
+    Score         total{};
+    unsigned long lineIndex = 0;
+    for (auto &fut:pool) {
+        for (const auto &lineScore:fut.get()) {
+            std::cout << lineScore.logProbability << "\t" << lineScore.perplexity() << "\t" << lines[lineIndex++] << std::endl;
+            total.merge(lineScore);
+        }
+    }
+
+    double delta = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - start).count();
+    std::cout << "Scored " << lines.size() << " lines, " << total.count << " tokens (" << total.outOfVocabulary
+              << " out of vocabulary) in " << delta << "ms." << std::endl;
+    std::cout << "Log-probability: " << total.logProbability << ", perplexity: " << total.perplexity() << std::endl;
 }
 
 std::string Dictionary::toString() const {
@@ -2,6 +2,9 @@
 #define SHINGLES_DICTIONARY_HPP
 
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
 #include <string>
 #include <regex>
 #include <vector>
@@ -12,31 +15,162 @@
 #include <stack>
 #include "utils/split.hpp"
 #include "Word.hpp"
+#include "Score.hpp"
+#include "Topic.hpp"
+#include "Journal.hpp"
+#include "NgramRuns.hpp"
+#include "utils/intern.hpp"
+#include "utils/perfect_hash.hpp"
+
+/**
+ * Parsed text ready to be counted: its words cut into sentences, each one from <s> to </s> with its
+ * markers closed, laid end to end. Built by the parsing threads so that counting is all that is left.
+ */
+struct TokenizedText {
+    std::vector<Word *>   words{};
+    // Where each sentence ends in words
+    std::vector<uint32_t> ends{};
+    // Journal records of the text, one line per sentence, when the dictionary is journaling
+    std::string           records{};
+    // Where the record of each sentence ends in records
+    std::vector<size_t>   recordEnds{};
+    // Every sentence of the text counts this many times
+    double                weight{1};
+};
 
 class Dictionary {
 public:
     explicit Dictionary(unsigned long n = 3);
     void ingestFile(const std::string &filePath);
+    void ingestFiles(const std::vector<std::string> &patterns);
+    void build(const std::vector<std::string> &patterns, const std::string &path, unsigned long memory);
+    void merge(const std::vector<std::string> &paths, const std::string &path, unsigned long memory);
     void input(const std::string &text);
-    void ingest(std::vector<std::string> &words, bool doUpdateProbabilities = false);
-    void ingestSentence(std::vector<Word *> &sentenceWords, bool doUpdateProbabilities = false);
+    void ingest(std::vector<std::string> &words, double weight = 1, bool doUpdateProbabilities = false);
+    void ingest(const TokenizedText &text, bool doUpdateProbabilities = false);
+    void tokenize(const std::vector<std::string> &words, TokenizedText &text);
+    Word *internWord(const std::string &text);
+    void ingestSentence(std::vector<Word *> &sentenceWords, unsigned long count, bool doUpdateProbabilities = false);
     void updateProbabilities();
-    std::vector<const std::string> nextCandidateWords(std::string seed = "") const;
+    void decay(double factor);
+    std::vector<std::string> nextCandidateWords(std::string seed = "") const;
     std::string nextMostProbableWord(std::string seed = "") const;
+    void updateTopic(Topic &topic, const std::string &text) const;
     std::string generate(std::string topic = "", std::string seed = "") const;
-    void open(const std::string &path);
-    void save(const std::string &path) const;
+    std::string generate(const Topic &topic, std::string seed = "") const;
+    void generate(const Topic &topic, const std::string &seed, std::string &sentenceText) const;
+    Score score(const std::string &text) const;
+    void scoreFile(const std::string &filePath) const;
+    bool open(const std::string &path);
+    void save(const std::string &path);
     std::string toString() const;
     void setDebug();
     void setDebug(bool debug);
+    void setBestOf(unsigned long bestOf);
+    void setBeamWidth(unsigned long beamWidth);
+    void setTopicWeight(double topicWeight);
+    void setSketch(unsigned long threshold);
+    void setDedup(unsigned long copies);
+    void setInputWeight(double weight);
+
+    // Walking the dictionary one word at a time, for models built on top of it (see Blend)
+    static const unsigned long maxSentenceLength{10};
+    const Word *findWord(const std::string &text) const;
+    const Gram *advance(const Gram *context, const Word *word) const;
+    double probability(const Gram *context, const Word *word) const;
+    std::string render(const std::vector<const Word *> &sentence) const;
+    void render(const std::vector<const Word *> &sentence, std::string &sentenceText) const;
 
 private:
+    // Buffers of a generation, one set per thread and reused so that steady-state generation does not allocate
+    struct Scratch {
+        std::vector<const Word *> seed{};
+        std::vector<const Word *> sentence{};
+        std::vector<const Gram *> contexts{};
+        MarkerStack               markerStack{};
+    };
+    static Scratch &scratch();
+
+    static const std::string   binaryMagic;
+    static const unsigned long binaryVersion{1};
+
+    static unsigned long fileSize(const std::string &path);
+    static std::string snapshotId();
+    bool readJson(const std::string &path, std::string &id, std::unordered_map<unsigned long, std::unique_ptr<Word>> &wordsById);
+    bool readBinary(const std::string &path, std::string &id, std::unordered_map<unsigned long, std::unique_ptr<Word>> &wordsById);
+    bool writeJson(const std::string &path, const std::string &id) const;
+    std::vector<const Word *> writeBinaryHeader(std::string &out, const std::string &id) const;
+    bool writeBinary(const std::string &path, const std::string &id) const;
+    bool writeRuns(const std::string &path);
+    void compactJournal();
+    void remapIds();
+    void indexWords();
+    void indexVocabulary();
+    void adoptWords();
+    void reportDedup();
+    unsigned long scaledCount(double weight);
+    void rescaleCounts();
+    unsigned long ingestBlocks(std::istream &stream, double weight = 1);
+
+    void selectWalkers();
+    const Gram *descend(const Word *word, const std::vector<const Word *> &sentence, unsigned long position) const;
+    const std::vector<const Word *> &walk(const std::vector<const Word *> &seed, const Topic &topicWords, bool debug) const;
+    std::vector<const Word *> beamSearch(const std::vector<const Word *> &seed, const Topic &topicWords) const;
+    double rank(const std::vector<const Word *> &sentence, unsigned long seedSize, const Topic &topicWords) const;
+
     bool          debug_{false};
+    unsigned long bestOf_{1};
+    unsigned long beamWidth_{1};
+    double        topicWeight_{0};
+    // Approximate counting of deep grams while ingesting, see Gram::update
+    std::unique_ptr<CountMinSketch> sketch_{};
+    unsigned long                   sketchThreshold_{0};
+    // Sentence fingerprints seen while ingesting, to count at most dedupCopies_ copies of a sentence
+    std::unique_ptr<CountMinSketch> dedup_{};
+    unsigned long                   dedupCopies_{0};
+    unsigned long                   dedupSentences_{0};
+    unsigned long                   dedupSkipped_{0};
+    // Counts are stored divided by countScale_, so that decaying them all only multiplies it (see decay).
+    // countCarry_ is the fraction of an occurrence left over by the last scaled count.
+    static constexpr double         minCountScale{1.0 / 1024};
+    double                          countScale_{1};
+    double                          countCarry_{0};
+    // Weight of the text typed in, and the one in effect at the end of the journal
+    double                          inputWeight_{1};
+    double                          journalWeight_{1};
+    // Set while building on disk, sentences are counted there instead of the grams
+    std::unique_ptr<NgramRuns>      runs_{};
     unsigned long n{2};
-    unsigned long idCounter{5}; // 0-5 reserved for begin & end words
+    // Gram walkers unrolled for the common n, nullptr to use the recursive ones
+    void (Gram::*updateFixed_)(const std::vector<Word *> &, unsigned long, unsigned long){nullptr};
+    const Gram *(Gram::*descendFixed_)(const std::vector<const Word *> &, unsigned long) const {nullptr};
+    std::atomic<unsigned long> idCounter{5}; // Last id given, markers are created first with ids 0-5
+    // Bumped whenever remapIds renumbers the words, markers included
+    unsigned long idsVersion_{0};
     Word *beginSentence{nullptr};
     Word *endSentence{nullptr};
     std::unordered_map<std::string, std::unique_ptr<Word>> wordMap{};
+    // Words removed by rescaleCounts, kept until the next open as a topic or the sketches may still
+    // refer to them. Their id is past those of the words in wordMap, so that they match no gram.
+    std::vector<std::unique_ptr<Word>>                     retiredWords_{};
+    // Perfect hash of wordMap for lookups once loaded or saved, cleared as soon as a word is added
+    PerfectHash<const Word *>                              wordIndex{};
+
+    struct InputText {
+        const std::string &operator()(const Word *word) const {
+            return word->getInputText();
+        }
+    };
+    // Concurrent index of wordMap used while ingesting, parsing threads intern their words in it.
+    // Words they create wait in createdWords until the ingesting thread adopts them into wordMap.
+    InternTable<Word *, InputText>     vocabulary{};
+    std::mutex                         createdWordsMutex{};
+    std::vector<std::unique_ptr<Word>> createdWords{};
+
+    // Dictionary file and the journal of what was learned since it was saved
+    std::string   path{};
+    unsigned long snapshotSize{0};
+    Journal       journal{};
 };
 
 
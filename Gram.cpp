@@ -1,3 +1,4 @@
+#include <cmath>
 #include "Gram.hpp"
 #include "Word.hpp"
 #include "utils/color.hpp"
@@ -9,6 +10,19 @@ const Word *Gram::getWord() const {
     return word;
 }
 
+const Gram *Gram::getSuffix() const {
+    return suffix;
+}
+
+unsigned int Gram::getDepth() const {
+    return depth;
+}
+
+const Gram *Gram::find(unsigned long wordId) const {
+    auto search = grams.find(wordId);
+    return search != grams.end() ? search->second.get() : nullptr;
+}
+
 const unsigned long Gram::getCount() const {
     return count;
 }
@@ -37,28 +51,33 @@ const Json::Value Gram::toJson() const {
     return gramJson;
 }
 
-void Gram::fromJson(const Json::Value &gram_json, std::unordered_map<unsigned long, std::unique_ptr<Word>> &wordsById) {
-    const Json::Value word_json = gram_json["word"];
+void Gram::fromJson(const Json::Value &gram_json, const std::unordered_map<unsigned long, std::unique_ptr<Word>> &wordsById) {
+    const Json::Value &word_json = gram_json["word"];
     if (word_json.empty()) {
         std::cerr << "Missing gram word" << std::endl;
-        throw;
+        throw std::runtime_error("Invalid dictionary");
     }
 
-    unsigned long wordId = word_json.asUInt64();
-    word = wordsById[wordId].get();
+    // Read-only lookup, words are loaded from several threads
+    auto search = wordsById.find(word_json.asUInt64());
+    if (search == wordsById.end()) {
+        std::cerr << "Unknown gram word: " << word_json.asUInt64() << std::endl;
+        throw std::runtime_error("Invalid dictionary");
+    }
+    word = search->second.get();
 
-    const Json::Value count_json = gram_json["count"];
+    const Json::Value &count_json = gram_json["count"];
     if (count_json.empty()) {
         std::cerr << "Missing gram count" << std::endl;
-        throw;
+        throw std::runtime_error("Invalid dictionary");
     }
 
     count = count_json.asUInt64();
 
-    const Json::Value grams_json = gram_json["grams"];
-    if (grams_json.empty() || grams_json.type() != Json::arrayValue) {
+    const Json::Value &grams_json = gram_json["grams"];
+    if (grams_json.type() != Json::arrayValue) {
         std::cerr << "Missing gram grams" << std::endl;
-        throw;
+        throw std::runtime_error("Invalid dictionary");
     }
 
     for (const auto &i : grams_json) {
@@ -69,9 +88,67 @@ void Gram::fromJson(const Json::Value &gram_json, std::unordered_map<unsigned lo
     }
 };
 
-void Gram::update(const std::vector<Word *> &sentence, unsigned long position, unsigned long n) {
+/**
+ * Count, number of children then each child as its word id delta from the previous child followed by its own gram.
+ * Children are ordered by id so deltas stay small.
+ */
+void Gram::toBinary(std::string &out) const {
+    writeVarint(out, count);
+    writeVarint(out, grams.size());
+    unsigned long previousId = 0;
+    for (const auto &gram:grams) {
+        writeVarint(out, gram.first - previousId);
+        previousId = gram.first;
+        gram.second->toBinary(out);
+    }
+}
+
+void Gram::fromBinary(BinaryReader &reader, const std::unordered_map<unsigned long, std::unique_ptr<Word>> &wordsById) {
+    count = reader.varint();
+
+    unsigned long numGrams = reader.varint();
+    unsigned long wordId   = 0;
+    for (unsigned long i = 0; i < numGrams; ++i) {
+        wordId += reader.varint();
+        auto search = wordsById.find(wordId);
+        if (search == wordsById.end()) {
+            std::cerr << "Unknown gram word: " << wordId << std::endl;
+            throw std::runtime_error("Invalid dictionary");
+        }
+
+        std::unique_ptr<Gram> gram(new Gram()); // *new* because of private constructor
+        gram->word  = search->second.get();
+        gram->depth = depth + 1;
+        gram->fromBinary(reader, wordsById);
+        grams.emplace_hint(grams.end(), wordId, std::move(gram));
+    }
+}
+
+/**
+ * Key of the word sequence sentence[begin..end] for the sketch.
+ * Words are hashed by address, which unlike ids does not change when ids are remapped.
+ */
+static uint64_t sequenceKey(const std::vector<Word *> &sentence, unsigned long begin, unsigned long end) {
+    uint64_t key = 0;
+    for (unsigned long i = begin; i <= end; ++i) {
+        key = (key ^ reinterpret_cast<uintptr_t>(sentence[i])) * 0x9E3779B97F4A7C15ULL;
+        key ^= key >> 29;
+    }
+    return key;
+}
+
+/**
+ * Count the grams starting at position, increment times (more than once for weighted text).
+ * With a sketch, new grams deep enough are only counted in the sketch until their estimated count
+ * reaches the threshold, then promoted into the trie where they are counted exactly. Most deep
+ * grams are seen once, so they never take memory in the trie.
+ */
+void Gram::update(
+    const std::vector<Word *> &sentence, unsigned long position, unsigned long n, unsigned long increment,
+    CountMinSketch *sketch, unsigned long threshold
+) {
     // We've been seen one more time
-    ++count;
+    count += increment;
 
     // Go deeper more than one "gram" remaining and not yet at the end of the sentence
     position++;
@@ -80,13 +157,117 @@ void Gram::update(const std::vector<Word *> &sentence, unsigned long position, u
         Word *word  = sentence[position];
         auto search = grams.find(word->getId());
         if (search == grams.end()) {
+            // Sentences are ingested back to front so the suffix sequence already exists,
+            // unless it is itself still in the sketch
+            const Gram *suffixGram = suffix ? suffix->find(word->getId()) : word->getGram();
+
+            unsigned long initialCount = 0;
+            if (sketch != nullptr && depth + 1 >= sketchedDepth) {
+                unsigned long begin    = position - depth - 1;
+                unsigned long estimate = sketch->add(sequenceKey(sentence, begin, position));
+                if (estimate < threshold || suffixGram == nullptr) {
+                    // Also count the longer sequences, so that they have their full count when promoted in turn
+                    for (unsigned long end = position + 1, remaining = n - 1; remaining > 1 && end < sentence.size(); ++end, --remaining) {
+                        sketch->add(sequenceKey(sentence, begin, end));
+                    }
+                    return;
+                }
+                // Occurrences seen while in the sketch, this one is counted by the update below.
+                // The sketch counts occurrences, they are taken to weigh as much as this one.
+                initialCount = (estimate - 1) * increment;
+            }
+
             std::unique_ptr<Gram> gram = std::make_unique<Gram>(word, depth + 1);
             gram_ptr = gram.get();
+            gram_ptr->count  = initialCount;
+            gram_ptr->suffix = suffixGram;
             grams[word->getId()] = std::move(gram);
         } else {
             gram_ptr = search->second.get();
         }
-        gram_ptr->update(sentence, position, n - 1);
+        gram_ptr->update(sentence, position, n - 1, increment, sketch, threshold);
+    }
+}
+
+/**
+ * Same as update without a sketch, for a dictionary of compile-time n: the descent is a loop of
+ * N - 1 levels the compiler can unroll, instead of a recursion checking n at every level.
+ */
+template<unsigned long N>
+void Gram::updateFixed(const std::vector<Word *> &sentence, unsigned long position, unsigned long increment) {
+    Gram *gram = this;
+    gram->count += increment;
+
+    for (unsigned long level = 1; level < N; ++level) {
+        if (++position >= sentence.size()) {
+            return;
+        }
+        Word *word   = sentence[position];
+        auto  search = gram->grams.lower_bound(word->getId());
+        if (search == gram->grams.end() || search->first != word->getId()) {
+            std::unique_ptr<Gram> child = std::make_unique<Gram>(word, gram->depth + 1);
+            child->suffix = gram->suffix ? gram->suffix->find(word->getId()) : word->getGram();
+            search = gram->grams.emplace_hint(search, word->getId(), std::move(child));
+        }
+        gram = search->second.get();
+        gram->count += increment;
+    }
+}
+
+template void Gram::updateFixed<3>(const std::vector<Word *> &sentence, unsigned long position, unsigned long increment);
+template void Gram::updateFixed<4>(const std::vector<Word *> &sentence, unsigned long position, unsigned long increment);
+
+/**
+ * Multiply the counts by scale, rounded, and drop the followers left with a count of zero along with
+ * everything below them. Suffix links to dropped grams are left dangling, to be relinked.
+ * @return Number of dropped grams
+ */
+unsigned long Gram::rescale(double scale) {
+    count = static_cast<unsigned long>(std::llround(count * scale));
+
+    unsigned long pruned = 0;
+    for (auto gram = grams.begin(); gram != grams.end();) {
+        pruned += gram->second->rescale(scale);
+        if (gram->second->count == 0) {
+            // Rescaling by zero prunes and counts whatever is left below
+            pruned += gram->second->rescale(0) + 1;
+            gram = grams.erase(gram);
+        } else {
+            ++gram;
+        }
+    }
+    return pruned;
+}
+
+void Gram::linkSuffixes() {
+    for (const auto &gram:grams) {
+        gram.second->suffix = suffix ? suffix->find(gram.first) : gram.second->word->getGram();
+        gram.second->linkSuffixes();
+    }
+}
+
+/**
+ * Rebuild the children maps after their words were given new ids.
+ * Nodes are reinserted in the new id order so that the map is allocated in iteration order.
+ */
+void Gram::remapIds() {
+    std::vector<std::unique_ptr<Gram>> children{};
+    children.reserve(grams.size());
+    for (auto &gram:grams) {
+        children.push_back(std::move(gram.second));
+    }
+    grams.clear();
+
+    std::sort(
+        children.begin(), children.end(),
+        [](const std::unique_ptr<Gram> &a, const std::unique_ptr<Gram> &b) {
+            return a->word->getId() < b->word->getId();
+        }
+    );
+    for (auto &gram:children) {
+        gram->remapIds();
+        unsigned long id = gram->word->getId();
+        grams.emplace_hint(grams.end(), id, std::move(gram));
     }
 }
 
@@ -104,6 +285,37 @@ void Gram::computeProbability(unsigned long total) {
     }
 }
 
+/**
+ * Same as computeProbability(total), but children with a large fanout are handed to spawn
+ * to be computed as separate tasks instead of recursing into them.
+ */
+void Gram::computeProbability(unsigned long total, const std::function<void(Gram *, unsigned long)> &spawn) {
+    static const unsigned long spawnFanout = 64;
+
+    probability = (double) count / (double) total;
+
+    unsigned long count = 0;
+
+    for (const auto &gram:grams) {
+        count += gram.second->count;
+    }
+
+    for (const auto &gram:grams) {
+        if (gram.second->grams.size() >= spawnFanout) {
+            spawn(gram.second.get(), count);
+        } else {
+            gram.second->computeProbability(count);
+        }
+    }
+}
+
+/**
+ * Number of followers, used to estimate the size of the subtree.
+ */
+unsigned long Gram::size() const {
+    return grams.size();
+}
+
 std::vector<const Gram *> Gram::candidates(const std::vector<const Word *> &sentence, unsigned long position) const {
     std::vector<const Gram *> candidates;
 
@@ -153,9 +365,30 @@ const Gram *Gram::mostProbable(const std::vector<const Word *> &sentence, unsign
     return g;
 }
 
+/**
+ * Gram of sentence[position..] below this one, for a dictionary of compile-time n. Its followers are
+ * what candidates and mostProbable look at once the sentence is consumed. Sequences longer than
+ * N - 1 words have no gram, so they are rejected before walking.
+ */
+template<unsigned long N>
+const Gram *Gram::descendFixed(const std::vector<const Word *> &sentence, unsigned long position) const {
+    if (position + N - 1 < sentence.size()) {
+        return nullptr;
+    }
+
+    const Gram *gram = this;
+    for (unsigned long level = 1; level < N && gram != nullptr && position < sentence.size(); ++level) {
+        gram = gram->find(sentence[position++]->getId());
+    }
+    return gram;
+}
+
+template const Gram *Gram::descendFixed<3>(const std::vector<const Word *> &sentence, unsigned long position) const;
+template const Gram *Gram::descendFixed<4>(const std::vector<const Word *> &sentence, unsigned long position) const;
+
 const Gram *Gram::next(
     const std::vector<const Word *> &sentence, unsigned long position,
-    const std::stack<const Word *> &markerStack, std::vector<const Word *> topic,
+    const MarkerStack &markerStack, const Topic &topic,
     bool finishSentence, bool debug
 ) const {
 
@@ -178,189 +411,185 @@ const Gram *Gram::next(
                       << sentence[position]->getInputText() << Color::FG_DEFAULT << std::endl;
         }
     } else {
-        if (debug) {
-            std::cout << std::string(depth + 6, ' ') << "Gram " << Color::FG_CYAN << word->getInputText()
-                      << Color::FG_DEFAULT << " attempting to find a word from:" << std::endl;
-            for (const auto &gram:grams) {
-                std::cout << std::string(depth + 7, ' ') << Color::FG_YELLOW
-                          << std::to_string(gram.second->probability) << Color::FG_DEFAULT << "\t"
-                          << Color::FG_LIGHT_GRAY << gram.second->word->getInputText() << Color::FG_DEFAULT
-                          << std::endl;
-            }
-        }
-
-        // Try finishing the sentence asap
-        if (finishSentence) {
-            if (debug) {
-                std::cout << std::string(depth + 6, ' ')
-                          << "Trying to finish sentence, giving priority to marker stack: "
-                          << Color::FG_LIGHT_GRAY << markerStack.top()->getEndMarker()->getInputText()
-                          << Color::FG_DEFAULT << std::endl;
-            }
-
-            for (const auto &gram:grams) {
-                if (gram.first == markerStack.top()->getEndMarker()->getId()) {
-                    if (debug) {
-                        std::cout << std::string(depth + 7, ' ') << "Found closing marker "
-                                  << gram.second->word->getInputText() << ", use that instead" << std::endl;
-                    }
+        nextGram = sample(markerStack, topic, finishSentence, debug);
+    }
 
-                    return gram.second.get();
-                }
-            }
+    if (debug) {
+        if (nextGram != nullptr) {
+            std::cout << std::string(depth + 6, ' ') << "Returning " << Color::FG_CYAN
+                      << nextGram->word->getInputText() << Color::FG_DEFAULT << std::endl;
+        } else {
+            std::cout << std::string(depth + 6, ' ') << Color::FG_RED << "Nothing to return!" << Color::FG_DEFAULT
+                      << std::endl;
         }
+    }
 
-        double remainingProbability = 1.0;
+    return nextGram;
+}
 
-        std::unordered_map<unsigned long, const Gram *> skippedGrams{};
+const Gram *Gram::sample(
+    const MarkerStack &markerStack, const Topic &topic,
+    bool finishSentence, bool debug
+) const {
 
-        // Try to match the topic
-        std::vector<const Gram *> topicGrams;
+    const Gram *nextGram = nullptr;
 
-        for (const auto &w:topic) {
-            auto search = grams.find(w->getId());
-            if (search != grams.end()) {
-                const Gram *g = w->getGram();
-                topicGrams.push_back(g);
-                // Increment maximum probability since we are now adding duplicated to the lot
-                remainingProbability += g->probability;
-            }
+    if (debug) {
+        std::cout << std::string(depth + 6, ' ') << "Gram " << Color::FG_CYAN << word->getInputText()
+                  << Color::FG_DEFAULT << " attempting to find a word from:" << std::endl;
+        for (const auto &gram:grams) {
+            std::cout << std::string(depth + 7, ' ') << Color::FG_YELLOW
+                      << std::to_string(gram.second->probability) << Color::FG_DEFAULT << "\t"
+                      << Color::FG_LIGHT_GRAY << gram.second->word->getInputText() << Color::FG_DEFAULT
+                      << std::endl;
         }
+    }
 
+    // Try finishing the sentence asap
+    if (finishSentence) {
         if (debug) {
-            if (!topicGrams.empty()) {
-                std::cout << std::string(depth + 6, ' ') << "Topic-matching grams: " << Color::FG_DARK_GRAY;
-                for (const auto &gram:topicGrams) {
-                    std::cout << gram->word->getInputText() << " ";
-                }
-                std::cout << Color::FG_DEFAULT << std::endl;
-            } else {
-                std::cout << std::string(depth + 6, ' ') << "No topic-matching grams" << std::endl;
-            }
+            std::cout << std::string(depth + 6, ' ')
+                      << "Trying to finish sentence, giving priority to marker stack: "
+                      << Color::FG_LIGHT_GRAY << markerStack.top()->getEndMarker()->getInputText()
+                      << Color::FG_DEFAULT << std::endl;
         }
 
-        bool giveUp = false;
-        do {
-            std::random_device                     rd;
-            std::mt19937                           gen(rd());
-            std::uniform_real_distribution<double> dis(0, remainingProbability);
-            double                                 rnd           = dis(gen);
-            double                                 probabilities = 0;
-
-            // Give more probability to topic grams
-            for (const auto &gram:topicGrams) {
-                double probability = gram->probability;
-                if (probabilities < rnd && rnd <= (probabilities + probability)) {
-                    nextGram = gram;
-                    if (debug) {
-                        std::cout << std::string(depth + 6, ' ') << "Candidate " << Color::FG_YELLOW
-                                  << std::to_string(rnd) << Color::FG_DEFAULT << " "
-                                  << Color::FG_LIGHT_GRAY << nextGram->word->getInputText() << Color::FG_DEFAULT
-                                  << std::endl;
-                    }
-                    break;
+        for (const auto &gram:grams) {
+            if (gram.first == markerStack.top()->getEndMarker()->getId()) {
+                if (debug) {
+                    std::cout << std::string(depth + 7, ' ') << "Found closing marker "
+                              << gram.second->word->getInputText() << ", use that instead" << std::endl;
                 }
-                probabilities += probability;
+
+                return gram.second.get();
             }
+        }
+    }
 
-            // Do regular grams if no topic gram found
-            if (nextGram == nullptr) {
-                for (const auto &gram:grams) {
-                    double probability = gram.second->probability;
-                    if (probabilities < rnd && rnd <= (probabilities + probability)) {
-                        auto search = skippedGrams.find(gram.first);
-                        if (search != skippedGrams.end()) {
-                            // We got a probability match but we already skipped that gram
-                            // so continue to skip adding the probability
-                            continue;
-                        } else {
-                            // We got our gram
-                            nextGram = gram.second.get();
-                            if (debug) {
-                                std::cout << std::string(depth + 6, ' ') << "Candidate " << Color::FG_YELLOW
-                                          << std::to_string(rnd) << Color::FG_DEFAULT << " "
-                                          << Color::FG_LIGHT_GRAY << nextGram->word->getInputText() << Color::FG_DEFAULT
-                                          << std::endl;
-                            }
-                            break;
-                        }
-                    }
-                    probabilities += probability;
+    // Give more probability to topic grams, scaling their in-context probability by (1 + topic weight)
+    double remainingProbability = 1.0;
+
+    if (!topic.empty()) {
+        if (debug) {
+            std::cout << std::string(depth + 6, ' ') << "Topic-matching grams: " << Color::FG_DARK_GRAY;
+        }
+        for (const auto &entry:topic) {
+            auto search = grams.find(entry.id);
+            if (search != grams.end()) {
+                remainingProbability += search->second->probability * entry.weight;
+                if (debug) {
+                    std::cout << entry.word->getInputText() << " ";
                 }
             }
+        }
+        if (debug) {
+            std::cout << Color::FG_DEFAULT << std::endl;
+        }
+    }
 
-            if (nextGram != nullptr && nextGram->word->isMarker()) {
-                if (finishSentence && nextGram->word->isBeginMarker()) {
-                    if (debug) {
-                        std::cout << std::string(depth + 6, ' ') << Color::FG_RED
-                                  << "Trying to finish sentence, not opening new marker" << Color::FG_DEFAULT
-                                  << std::endl;
-                    }
+    // Seeded once per thread, and the few skipped markers in a buffer reused across calls,
+    // so that sampling does not allocate
+    static thread_local std::mt19937               gen(std::random_device{}());
+    static thread_local std::vector<unsigned long> skippedGrams{};
+    skippedGrams.clear();
 
-                    skippedGrams[nextGram->word->getId()] = nextGram;
-                    remainingProbability -= nextGram->probability;
-                    nextGram                              = nullptr;
+    bool giveUp = false;
+    do {
+        std::uniform_real_distribution<double> dis(0, remainingProbability);
+        double                                 rnd           = dis(gen);
+        double                                 probabilities = 0;
 
-                } else if (nextGram->word->isBeginMarker() && nextGram->word->getId() == markerStack.top()->getId()) {
-                    if (debug) {
-                        std::cout << std::string(depth + 6, ' ') << Color::FG_RED << "Can't open stacked marker: "
-                                  << markerStack.top()->getInputText() << Color::FG_DEFAULT << std::endl;
-                    }
+        // Grams and topic are both ordered by word id, walk them side by side
+        auto topicEntry = topic.begin();
 
-                    skippedGrams[nextGram->word->getId()] = nextGram;
-                    remainingProbability -= nextGram->probability;
-                    nextGram                              = nullptr;
+        for (const auto &gram:grams) {
+            if (!skippedGrams.empty() && std::find(skippedGrams.begin(), skippedGrams.end(), gram.first) != skippedGrams.end()) {
+                // Already skipped, its probability was taken out of the remaining probability
+                continue;
+            }
 
-                } else if (nextGram->word->isEndMarker() && nextGram->word->getBeginMarker()->getId() != markerStack.top()->getId()) {
-                    if (debug) {
-                        std::cout << std::string(depth + 6, ' ') << Color::FG_RED
-                                  << "Can't close unstacked marker: "
-                                  << nextGram->word->getInputText() << Color::FG_DEFAULT << std::endl;
-                    }
+            double probability = gram.second->probability;
+            while (topicEntry != topic.end() && topicEntry->id < gram.first) {
+                ++topicEntry;
+            }
+            if (topicEntry != topic.end() && topicEntry->id == gram.first) {
+                probability *= 1 + topicEntry->weight;
+            }
 
-                    skippedGrams[nextGram->word->getId()] = nextGram;
-                    remainingProbability -= nextGram->probability;
-                    nextGram                              = nullptr;
+            if (probabilities < rnd && rnd <= (probabilities + probability)) {
+                // We got our gram
+                nextGram = gram.second.get();
+                if (debug) {
+                    std::cout << std::string(depth + 6, ' ') << "Candidate " << Color::FG_YELLOW
+                              << std::to_string(rnd) << Color::FG_DEFAULT << " "
+                              << Color::FG_LIGHT_GRAY << nextGram->word->getInputText() << Color::FG_DEFAULT
+                              << std::endl;
                 }
+                break;
             }
+            probabilities += probability;
+        }
 
-            if (nextGram == nullptr && (grams.size() == skippedGrams.size() || remainingProbability <= 0)) {
-                giveUp = true;
+        if (nextGram != nullptr && nextGram->word->isMarker()) {
+            if (finishSentence && nextGram->word->isBeginMarker()) {
+                if (debug) {
+                    std::cout << std::string(depth + 6, ' ') << Color::FG_RED
+                              << "Trying to finish sentence, not opening new marker" << Color::FG_DEFAULT
+                              << std::endl;
+                }
 
+                skippedGrams.push_back(nextGram->word->getId());
+                remainingProbability -= nextGram->probability * (1 + topic.weight(nextGram->word->getId()));
+                nextGram = nullptr;
+
+            } else if (nextGram->word->isBeginMarker() && nextGram->word->getId() == markerStack.top()->getId()) {
                 if (debug) {
-                    if (grams.size() == skippedGrams.size()) {
-                        std::cout << std::string(depth + 6, ' ') << Color::FG_RED
-                                  << "No more grams remaining, giving up!" << Color::FG_DEFAULT << std::endl;
-                    } else if (remainingProbability <= 0) {
-                        std::cout << std::string(depth + 6, ' ') << Color::FG_RED
-                                  << "No more probabilities remaining, giving up!" << Color::FG_DEFAULT << std::endl;
-                    }
+                    std::cout << std::string(depth + 6, ' ') << Color::FG_RED << "Can't open stacked marker: "
+                              << markerStack.top()->getInputText() << Color::FG_DEFAULT << std::endl;
                 }
-            }
 
-            if (debug) {
-                if (nextGram != nullptr) {
-                    std::cout << std::string(depth + 6, ' ') << "Found " << Color::FG_CYAN
+                skippedGrams.push_back(nextGram->word->getId());
+                remainingProbability -= nextGram->probability * (1 + topic.weight(nextGram->word->getId()));
+                nextGram = nullptr;
+
+            } else if (nextGram->word->isEndMarker() && nextGram->word->getBeginMarker()->getId() != markerStack.top()->getId()) {
+                if (debug) {
+                    std::cout << std::string(depth + 6, ' ') << Color::FG_RED
+                              << "Can't close unstacked marker: "
                               << nextGram->word->getInputText() << Color::FG_DEFAULT << std::endl;
-                } else {
-                    std::cout << std::string(depth + 6, ' ') << Color::FG_RED << "Nothing Found!"
-                              << Color::FG_DEFAULT
-                              << std::endl;
                 }
+
+                skippedGrams.push_back(nextGram->word->getId());
+                remainingProbability -= nextGram->probability * (1 + topic.weight(nextGram->word->getId()));
+                nextGram = nullptr;
             }
-        } while (nextGram == nullptr && !giveUp);
+        }
 
-    }
+        if (nextGram == nullptr && (grams.size() == skippedGrams.size() || remainingProbability <= 0)) {
+            giveUp = true;
 
-    if (debug) {
-        if (nextGram != nullptr) {
-            std::cout << std::string(depth + 6, ' ') << "Returning " << Color::FG_CYAN
-                      << nextGram->word->getInputText() << Color::FG_DEFAULT << std::endl;
-        } else {
-            std::cout << std::string(depth + 6, ' ') << Color::FG_RED << "Nothing to return!" << Color::FG_DEFAULT
-                      << std::endl;
+            if (debug) {
+                if (grams.size() == skippedGrams.size()) {
+                    std::cout << std::string(depth + 6, ' ') << Color::FG_RED
+                              << "No more grams remaining, giving up!" << Color::FG_DEFAULT << std::endl;
+                } else if (remainingProbability <= 0) {
+                    std::cout << std::string(depth + 6, ' ') << Color::FG_RED
+                              << "No more probabilities remaining, giving up!" << Color::FG_DEFAULT << std::endl;
+                }
+            }
         }
-    }
+
+        if (debug) {
+            if (nextGram != nullptr) {
+                std::cout << std::string(depth + 6, ' ') << "Found " << Color::FG_CYAN
+                          << nextGram->word->getInputText() << Color::FG_DEFAULT << std::endl;
+            } else {
+                std::cout << std::string(depth + 6, ' ') << Color::FG_RED << "Nothing Found!"
+                          << Color::FG_DEFAULT
+                          << std::endl;
+            }
+        }
+    } while (nextGram == nullptr && !giveUp);
 
     return nextGram;
 }
@@ -2,46 +2,82 @@
 #define SHINGLES_GRAM_HPP
 
 #include <algorithm>
+#include <functional>
 #include <vector>
 #include <unordered_map>
 #include <iostream>
 #include <random>
 #include <memory>
 #include <stack>
+#include <stdexcept>
 #include <json/json.h>
+#include "Topic.hpp"
+#include "utils/binary.hpp"
+#include "utils/sketch.hpp"
 
 class Word;
 
+// Markers to close while generating, on a vector so that a reused stack keeps its storage
+using MarkerStack = std::stack<const Word *, std::vector<const Word *>>;
+
 class Gram {
 public:
     Gram(const Word *word, unsigned int depth = 0);
-    void update(const std::vector<Word *> &sentence, unsigned long position, unsigned long n);
+    void update(
+        const std::vector<Word *> &sentence, unsigned long position, unsigned long n, unsigned long increment = 1,
+        CountMinSketch *sketch = nullptr, unsigned long threshold = 0
+    );
+    template<unsigned long N>
+    void updateFixed(const std::vector<Word *> &sentence, unsigned long position, unsigned long increment);
+    unsigned long rescale(double scale);
+    void linkSuffixes();
+    void remapIds();
     void computeProbability(unsigned long total);
+    void computeProbability(unsigned long total, const std::function<void(Gram *, unsigned long)> &spawn);
+    unsigned long size() const;
     using candidates_t = std::vector<std::map<unsigned long, std::pair<unsigned long, const Word *>>>;
     std::vector<const Gram *> candidates(const std::vector<const Word *> &sentence, unsigned long position) const;
     const Gram *mostProbable(const std::vector<const Word *> &sentence, unsigned long position) const;
+    template<unsigned long N>
+    const Gram *descendFixed(const std::vector<const Word *> &sentence, unsigned long position) const;
     const Gram *next(
         const std::vector<const Word *> &sentence,
         unsigned long position,
-        const std::stack<const Word *> &markerStack,
-        std::vector<const Word *> topic,
+        const MarkerStack &markerStack,
+        const Topic &topic,
         bool finishSentence = false,
         bool debug = false
     ) const;
+    const Gram *sample(
+        const MarkerStack &markerStack,
+        const Topic &topic,
+        bool finishSentence = false,
+        bool debug = false
+    ) const;
+    const Gram *find(unsigned long wordId) const;
     const Word *getWord() const;
+    const Gram *getSuffix() const;
+    unsigned int getDepth() const;
     const unsigned long getCount() const;
     const double getProbability() const;
     const std::string toString() const;
     const Json::Value toJson() const;
-    void fromJson(const Json::Value &gram_json, std::unordered_map<unsigned long, std::unique_ptr<Word>> &wordsById);
+    void fromJson(const Json::Value &gram_json, const std::unordered_map<unsigned long, std::unique_ptr<Word>> &wordsById);
+    void toBinary(std::string &out) const;
+    void fromBinary(BinaryReader &reader, const std::unordered_map<unsigned long, std::unique_ptr<Word>> &wordsById);
 
 private:
     Gram() = default;
 
+    // Grams at this depth and deeper (trigrams and up) go through the sketch, when there is one
+    static const unsigned int sketchedDepth{2};
+
     const Word                                     *word;
     unsigned long                                  count{0};
     double                                         probability{0};
     unsigned int                                   depth{0};
+    // Backoff link to the gram of the same sequence minus its first word, nullptr on root grams
+    const Gram                                     *suffix{nullptr};
     //std::map<unsigned long, std::pair<unsigned long, const Word *>> words{};
     std::map<unsigned long, std::unique_ptr<Gram>> grams{};
 };
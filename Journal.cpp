@@ -0,0 +1,134 @@
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <unistd.h>
+#include "Journal.hpp"
+#include "utils/split.hpp"
+
+static const std::string header = "#shingles-journal ";
+static const char        directiveMark = '\x1e';
+
+std::string Journal::pathFor(const std::string &dictionaryPath) {
+    return dictionaryPath + ".journal";
+}
+
+/**
+ * Replay the journal records through the callback, if the journal belongs to the snapshot id.
+ * @static
+ * @return Number of replayed records
+ */
+unsigned long Journal::replay(
+    const std::string &path, const std::string &id, std::function<void(std::vector<std::string> &)> callback
+) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return 0;
+    }
+
+    std::string line;
+    if (!std::getline(file, line) || line != header + id) {
+        std::cerr << "Ignoring journal not matching the dictionary: " << path << std::endl;
+        return 0;
+    }
+
+    unsigned long records = 0;
+    while (std::getline(file, line)) {
+        // A crash can leave a truncated last record, the newline is only written with a complete record
+        if (file.eof()) {
+            break;
+        }
+        std::vector<std::string> words = split(line, ' ');
+        if (!words.empty()) {
+            callback(words);
+            ++records;
+        }
+    }
+
+    return records;
+}
+
+/**
+ * Directive record, replayed as the two words {name, value} marked as a directive.
+ * @static
+ */
+std::string Journal::directive(const std::string &name, double value) {
+    std::ostringstream record{};
+    record.precision(std::numeric_limits<double>::max_digits10);
+    record << directiveMark << name << ' ' << value << '\n';
+    return record.str();
+}
+
+/**
+ * Whether a replayed record is a directive, its mark is then removed.
+ * @static
+ */
+bool Journal::isDirective(std::vector<std::string> &record) {
+    if (record.size() != 2 || record[0].empty() || record[0][0] != directiveMark) {
+        return false;
+    }
+    record[0].erase(0, 1);
+    return true;
+}
+
+void Journal::open(const std::string &path, const std::string &id, bool truncate) {
+    close();
+
+    bool exists = false;
+    if (!truncate) {
+        std::ifstream existing(path, std::ios::binary);
+        std::string   line;
+        if (existing && std::getline(existing, line) && line == header + id) {
+            // Drop a truncated last record so that appended records start on their own line
+            existing.seekg(0, std::ios::end);
+            auto end = static_cast<unsigned long>(existing.tellg());
+            bytes = end;
+            char c{};
+            while (bytes > 0 && existing.seekg(bytes - 1) && existing.get(c) && c != '\n') {
+                --bytes;
+            }
+            exists = true;
+            if (bytes < end && ::truncate(path.c_str(), bytes) != 0) {
+                std::cerr << "Can't repair journal: " << path << std::endl;
+            }
+        }
+    }
+
+    if (exists) {
+        file.open(path, std::ios::binary | std::ios::app);
+    } else {
+        file.open(path, std::ios::binary | std::ios::trunc);
+        file << header << id << "\n" << std::flush;
+        bytes = header.size() + id.size() + 1;
+    }
+
+    if (!file) {
+        std::cerr << "Can't open journal: " << path << std::endl;
+    }
+}
+
+void Journal::close() {
+    if (file.is_open()) {
+        file.close();
+    }
+    bytes = 0;
+}
+
+bool Journal::isOpen() const {
+    return file.is_open();
+}
+
+/**
+ * Append records already formatted, each one a line of space separated words.
+ */
+void Journal::append(const std::string &records) {
+    if (!file.is_open() || records.empty()) {
+        return;
+    }
+
+    file << records << std::flush;
+    bytes += records.size();
+}
+
+unsigned long Journal::size() const {
+    return bytes;
+}
@@ -0,0 +1,37 @@
+#ifndef SHINGLES_JOURNAL_HPP
+#define SHINGLES_JOURNAL_HPP
+
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * Append-only journal of ingested words, kept next to a dictionary file.
+ * Each record is one line of space separated words (the parser never outputs words containing
+ * spaces), or a directive such as the weight of the following records: a name and a value, marked
+ * by a control character that the parser never outputs either. The first line holds the id of the
+ * snapshot the journal applies to, so that a journal left behind by an interrupted compaction is
+ * never replayed twice.
+ */
+class Journal {
+public:
+    static std::string pathFor(const std::string &dictionaryPath);
+    static unsigned long replay(
+        const std::string &path, const std::string &id, std::function<void(std::vector<std::string> &)> callback
+    );
+    static std::string directive(const std::string &name, double value);
+    static bool isDirective(std::vector<std::string> &record);
+
+    void open(const std::string &path, const std::string &id, bool truncate = false);
+    void close();
+    bool isOpen() const;
+    void append(const std::string &records);
+    unsigned long size() const;
+
+private:
+    std::ofstream file{};
+    unsigned long bytes{0};
+};
+
+#endif //SHINGLES_JOURNAL_HPP
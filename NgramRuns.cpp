@@ -0,0 +1,262 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <stdexcept>
+#include "NgramRuns.hpp"
+#include "Word.hpp"
+#include "utils/binary.hpp"
+
+namespace {
+    /**
+     * Sequential reader of a run: key length, key, count.
+     */
+    struct RunReader {
+        std::ifstream file;
+        std::string   key{};
+        unsigned long count{0};
+
+        explicit RunReader(const std::string &path) : file(path, std::ios::binary) {}
+
+        bool next() {
+            if (file.peek() == EOF) {
+                return false;
+            }
+            key   = readString(file);
+            count = readVarint(file);
+            return static_cast<bool>(file);
+        }
+    };
+
+    /**
+     * Rebuilds word blocks from windows in sorted order. Only the path of the last window is open,
+     * every other gram is already serialized into its parent, so memory is bounded by the largest
+     * serialized word block rather than by the trie.
+     */
+    class BlockWriter {
+    public:
+        explicit BlockWriter(std::ostream &out) : out(out) {}
+
+        void add(const std::string &key, unsigned long count) {
+            unsigned long length = key.size() / 4;
+            std::vector<unsigned long> ids(length);
+            for (unsigned long i = 0; i < length; ++i) {
+                ids[i] = (static_cast<unsigned long>(static_cast<unsigned char>(key[i * 4])) << 24)
+                         | (static_cast<unsigned long>(static_cast<unsigned char>(key[i * 4 + 1])) << 16)
+                         | (static_cast<unsigned long>(static_cast<unsigned char>(key[i * 4 + 2])) << 8)
+                         | static_cast<unsigned long>(static_cast<unsigned char>(key[i * 4 + 3]));
+            }
+
+            unsigned long common = 0;
+            while (common < path.size() && common < length && path[common].id == ids[common]) {
+                ++common;
+            }
+            close(common);
+
+            for (unsigned long depth = path.size(); depth < length; ++depth) {
+                if (depth == 0) {
+                    emptyBlocksUntil(ids[0]);
+                }
+                path.push_back(Node{ids[depth]});
+            }
+            for (unsigned long depth = 0; depth < length; ++depth) {
+                path[depth].count += count;
+            }
+        }
+
+        void finish(unsigned long wordCount) {
+            close(0);
+            emptyBlocksUntil(wordCount);
+        }
+
+    private:
+        struct Node {
+            unsigned long id;
+            unsigned long count{0};
+            unsigned long children{0};
+            unsigned long previousId{0};
+            std::string   grams{};
+        };
+
+        void close(unsigned long depth) {
+            while (path.size() > depth) {
+                Node node = std::move(path.back());
+                path.pop_back();
+
+                std::string gram{};
+                writeVarint(gram, node.count);
+                writeVarint(gram, node.children);
+                gram += node.grams;
+
+                if (path.empty()) {
+                    writeBlock(gram);
+                } else {
+                    Node &parent = path.back();
+                    writeVarint(parent.grams, node.id - parent.previousId);
+                    parent.previousId = node.id;
+                    ++parent.children;
+                    parent.grams += gram;
+                }
+            }
+        }
+
+        // Words never starting a window still get their (empty) block
+        void emptyBlocksUntil(unsigned long id) {
+            while (nextWord < id) {
+                std::string gram{};
+                writeVarint(gram, 0);
+                writeVarint(gram, 0);
+                writeBlock(gram);
+            }
+        }
+
+        void writeBlock(const std::string &gram) {
+            std::string block{};
+            writeString(block, gram);
+            out.write(block.data(), block.size());
+            ++nextWord;
+        }
+
+        std::ostream      &out;
+        std::vector<Node> path{};
+        unsigned long     nextWord{0};
+    };
+}
+
+NgramRuns::NgramRuns(std::string prefix, unsigned long n, unsigned long memory) :
+    prefix(std::move(prefix)), n(n), memory(memory) {}
+
+NgramRuns::~NgramRuns() {
+    for (unsigned long run = 0; run < runs; ++run) {
+        std::remove(runPath(run).c_str());
+    }
+}
+
+unsigned long NgramRuns::size() const {
+    return runs;
+}
+
+std::string NgramRuns::runPath(unsigned long run) const {
+    return prefix + ".run" + std::to_string(run);
+}
+
+void NgramRuns::add(const std::vector<Word *> &sentence, unsigned long count) {
+    for (unsigned long i = 0; i < sentence.size(); ++i) {
+        push(sentence, i, std::min(n, sentence.size() - i), count);
+    }
+
+    if (bufferBytes >= memory) {
+        spill();
+    }
+}
+
+/**
+ * Count the window sentence[begin..begin + length - 1] count times.
+ */
+void NgramRuns::add(const std::vector<Word *> &sentence, unsigned long begin, unsigned long length, unsigned long count) {
+    push(sentence, begin, length, count);
+
+    if (bufferBytes >= memory) {
+        spill();
+    }
+}
+
+void NgramRuns::push(const std::vector<Word *> &sentence, unsigned long begin, unsigned long length, unsigned long count) {
+    std::string window(length * 4, '\0');
+    for (unsigned long j = 0; j < length; ++j) {
+        unsigned long id = sentence[begin + j]->getId();
+        window[j * 4]     = static_cast<char>(id >> 24);
+        window[j * 4 + 1] = static_cast<char>(id >> 16);
+        window[j * 4 + 2] = static_cast<char>(id >> 8);
+        window[j * 4 + 3] = static_cast<char>(id);
+    }
+    bufferBytes += sizeof(Window) + window.capacity();
+    windows.emplace_back(std::move(window), count);
+}
+
+/**
+ * Sort the buffered windows and write them as a run, identical windows counted once.
+ */
+void NgramRuns::spill() {
+    if (windows.empty()) {
+        return;
+    }
+
+    std::sort(windows.begin(), windows.end());
+
+    std::ofstream file(runPath(runs), std::ios::binary);
+    std::string   out{};
+    for (unsigned long i = 0; i < windows.size();) {
+        unsigned long count = 0;
+        unsigned long j     = i;
+        for (; j < windows.size() && windows[j].first == windows[i].first; ++j) {
+            count += windows[j].second;
+        }
+        writeString(out, windows[i].first);
+        writeVarint(out, count);
+        if (out.size() >= 1 << 20) {
+            file.write(out.data(), out.size());
+            out.clear();
+        }
+        i = j;
+    }
+    file.write(out.data(), out.size());
+    if (!file) {
+        throw std::runtime_error("Could not write run " + runPath(runs));
+    }
+
+    std::cout << "    Spilled run " << runs << " (" << windows.size() << " windows)" << std::endl;
+    ++runs;
+    std::vector<Window>().swap(windows);
+    bufferBytes = 0;
+}
+
+/**
+ * Merge all runs and write the word blocks of words 0 to wordCount - 1.
+ */
+bool NgramRuns::merge(std::ostream &out, unsigned long wordCount) {
+    spill();
+    std::cout << "Merging " << runs << " runs..." << std::endl;
+
+    std::vector<std::unique_ptr<RunReader>> readers{};
+    auto greater = [&readers](unsigned long a, unsigned long b) {
+        return readers[a]->key > readers[b]->key;
+    };
+    std::priority_queue<unsigned long, std::vector<unsigned long>, decltype(greater)> heap(greater);
+
+    try {
+        for (unsigned long run = 0; run < runs; ++run) {
+            readers.push_back(std::make_unique<RunReader>(runPath(run)));
+            if (readers.back()->next()) {
+                heap.push(run);
+            }
+        }
+
+        BlockWriter writer(out);
+        std::string key{};
+        while (!heap.empty()) {
+            key = readers[heap.top()]->key;
+
+            // Same window from every run
+            unsigned long count = 0;
+            while (!heap.empty() && readers[heap.top()]->key == key) {
+                unsigned long run = heap.top();
+                heap.pop();
+                count += readers[run]->count;
+                if (readers[run]->next()) {
+                    heap.push(run);
+                }
+            }
+
+            writer.add(key, count);
+        }
+        writer.finish(wordCount);
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return false;
+    }
+
+    return static_cast<bool>(out);
+}
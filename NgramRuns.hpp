@@ -0,0 +1,45 @@
+#ifndef SHINGLES_NGRAM_RUNS_HPP
+#define SHINGLES_NGRAM_RUNS_HPP
+
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Word;
+
+/**
+ * Out-of-core n-gram counting, for corpora whose trie would not fit in memory.
+ * Sentences are cut into windows of up to n word ids, buffered up to a memory budget, then sorted,
+ * aggregated and spilled to temporary files as sorted runs. A k-way merge of the runs streams the
+ * word blocks of the binary dictionary format (see Gram::toBinary) one word after the other.
+ * A window adds its count (that of its sentence, or any weight when merging dictionaries) to every
+ * gram along its path, so the counts of shorter grams are the sums of the windows they prefix, which
+ * are contiguous in sorted order.
+ */
+class NgramRuns {
+public:
+    NgramRuns(std::string prefix, unsigned long n, unsigned long memory);
+    ~NgramRuns();
+    void add(const std::vector<Word *> &sentence, unsigned long count = 1);
+    void add(const std::vector<Word *> &sentence, unsigned long begin, unsigned long length, unsigned long count);
+    bool merge(std::ostream &out, unsigned long wordCount);
+    unsigned long size() const;
+
+private:
+    using Window = std::pair<std::string, unsigned long>;
+
+    void push(const std::vector<Word *> &sentence, unsigned long begin, unsigned long length, unsigned long count);
+    void spill();
+    std::string runPath(unsigned long run) const;
+
+    std::string              prefix;
+    unsigned long            n;
+    unsigned long            memory;
+    // Windows as big endian 32 bit ids, so that byte order is id order and prefixes sort first, with their count
+    std::vector<Window>      windows{};
+    unsigned long            bufferBytes{0};
+    unsigned long            runs{0};
+};
+
+#endif //SHINGLES_NGRAM_RUNS_HPP
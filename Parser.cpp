@@ -2,6 +2,7 @@
 #include <fstream>
 #include <vector>
 #include "utils/split.hpp"
+#include "utils/text.hpp"
 #include "Parser.hpp"
 
 void Parser::parse(const std::string &text, std::function<void(std::vector<std::string> &)> callback, std::function<void(void)> done, bool debug) {
@@ -11,11 +12,8 @@ void Parser::parse(const std::string &text, std::function<void(std::vector<std::
     if (debug) {
         std::cout << "Splitting text into chunks..." << std::endl;
     }
-    std::regex                 re("[\n]{2,}"); // Two or more line returns should not split sentences ;)
-    std::sregex_token_iterator first{text.cbegin(), text.cend(), re, -1};
-    std::sregex_token_iterator last;
-    std::vector<std::string>   chunks{first, last};
-    unsigned long              numChunks = chunks.size();
+    std::vector<std::string> chunks    = splitParagraphs(text);
+    unsigned long            numChunks = chunks.size();
 
     if (debug) {
         std::cout << "Threading " << numChunks << " chunk parsers..." << std::endl;
@@ -59,6 +57,65 @@ void Parser::parse(const std::string &text, std::function<void(std::vector<std::
     done();
 }
 
+namespace {
+    /**
+     * Regular expressions of the parser, compiled once and shared by every parsing thread
+     * (a std::regex can be used concurrently once built).
+     */
+    struct Normalizer {
+        const std::vector<std::pair<std::string, std::string>> quoteMarkerPairs{
+            std::make_pair("\"", "\""),
+            std::make_pair("“", "”"),
+            std::make_pair("‘", "’"),
+            std::make_pair("«", "»")
+        };
+        const std::vector<std::pair<std::string, std::string>> parensMarkerPairs{
+            std::make_pair("\\(", "\\)"),
+            std::make_pair("\\[", "\\]"),
+            std::make_pair("\\{", "\\}")
+        };
+
+        const std::regex        paragraphs{"[\n]{2,}"}; // Two or more line returns should not split sentences ;)
+        const std::regex        dashes{"-{2,}"};
+        const std::regex        urls{"http[s]?:\\/\\/(?:.+?) "};
+        const std::regex        markerLike{"<(.+?)>"};
+        const std::regex        angleBrackets{"[<>]"};
+        std::vector<std::regex> quotes{};
+        const std::regex        singleQuotes{"([^A-Za-z0-9])'(.+?)'([^A-Za-z0-9])"};
+        const std::regex        apostrophes{"'"};
+        std::vector<std::regex> parens{};
+        std::regex              strayMarkers{};
+
+        Normalizer() {
+            // Alternation rather than a bracket expression, which would match the single bytes of multi-byte markers
+            std::string stray = "";
+
+            for (const auto &marker : quoteMarkerPairs) {
+                quotes.emplace_back(marker.first + "(.+?)" + marker.second);
+                stray += (stray.empty() ? "" : "|") + marker.first + "|" + marker.second;
+            }
+
+            for (const auto &marker : parensMarkerPairs) {
+                parens.emplace_back(marker.first + "(.+?)" + marker.second);
+                stray += "|" + marker.first + "|" + marker.second;
+            }
+
+            strayMarkers = std::regex(stray);
+        }
+    };
+
+    const Normalizer &normalizer() {
+        static const Normalizer normalizer{};
+        return normalizer;
+    }
+}
+
+std::vector<std::string> Parser::splitParagraphs(const std::string &text) {
+    std::sregex_token_iterator first{text.cbegin(), text.cend(), normalizer().paragraphs, -1};
+    std::sregex_token_iterator last;
+    return {first, last};
+}
+
 //void saveIntermediate(std::string name, std::string buff) {
 //    std::string   file = "output-" + name + ".txt";
 //    std::ofstream output(file.c_str());
@@ -66,69 +123,57 @@ void Parser::parse(const std::string &text, std::function<void(std::vector<std::
 //}
 
 std::vector<std::string> Parser::parseChunk(std::string textBuffer, bool debug) {
+    const Normalizer &re = normalizer();
 
     // Remove crap, double space replace in order to eliminate crap for quotes to quotes not being replaced byt their regex
     if (debug) {
         std::cout << "Removing crap..." << std::endl;
     }
 
-    textBuffer = std::regex_replace(textBuffer, std::regex("[\\x00-\\x1F_]"), "  ");
-    textBuffer = std::regex_replace(textBuffer, std::regex("-{2,}"), "  ");
-    textBuffer = std::regex_replace(textBuffer, std::regex("http[s]?:\\/\\/(?:.+?) "), " ");
+    Text::replaceControlCharacters(textBuffer);
+    textBuffer = std::regex_replace(textBuffer, re.dashes, "  ");
+    textBuffer = std::regex_replace(textBuffer, re.urls, " ");
 
     // Make punctuation actual words
     if (debug) {
         std::cout << "Separating punctuation..." << std::endl;
     }
 
-    textBuffer = std::regex_replace(textBuffer, std::regex("\\.\\.\\."), " … "); // elipsis
-    textBuffer = std::regex_replace(textBuffer, std::regex("([\\.\\,\\:\\;\\!\\?\\(\\)\"“”«»])"), " $1 ");
+    // Also turns "..." into an ellipsis, multi-byte punctuation is matched as whole characters
+    textBuffer = Text::separatePunctuation(textBuffer);
 
     // Before starting to add markers, start by removing anything resembling one
     if (debug) {
         std::cout << "Removing marker-like structures..." << std::endl;
     }
 
-    textBuffer = std::regex_replace(textBuffer, std::regex("<(.+?)>"), "($1)");
-    textBuffer = std::regex_replace(textBuffer, std::regex("[<>]"), " ");
+    textBuffer = std::regex_replace(textBuffer, re.markerLike, "($1)");
+    textBuffer = std::regex_replace(textBuffer, re.angleBrackets, " ");
 
     // Extract quotes
     if (debug) {
         std::cout << "Extracting quotes..." << std::endl;
     }
 
-    std::vector<std::pair<std::string, std::string>> quoteMarkerPairs{
-        std::make_pair("\"", "\""),
-        std::make_pair("“", "”"),
-        std::make_pair("‘", "’"),
-        std::make_pair("«", "»")
-    };
-
-    for (auto marker : quoteMarkerPairs) {
-        textBuffer = std::regex_replace(textBuffer, std::regex(marker.first + "(.+?)" + marker.second), " <q> $1 </q> ");
+    for (const auto &quote : re.quotes) {
+        textBuffer = std::regex_replace(textBuffer, quote, " <q> $1 </q> ");
     }
 
     // Special case with spaces not to catch real apostrophes
     // We don't want it to be in the stray marker removal also
     //textBuffer = std::regex_replace(textBuffer, std::regex("(?:^| )'(.+?)'(?:$| )"), "<q> $1 </q>");
-    textBuffer = std::regex_replace(textBuffer, std::regex("([^A-Za-z0-9])'(.+?)'([^A-Za-z0-9])"), "$1 <q> $2 </q> $3");
+    textBuffer = std::regex_replace(textBuffer, re.singleQuotes, "$1 <q> $2 </q> $3");
 
     // Experiment: try to put apostrophes as words
-    textBuffer = std::regex_replace(textBuffer, std::regex("'"), " ' ");
+    textBuffer = std::regex_replace(textBuffer, re.apostrophes, " ' ");
 
     // Extract parens
     if (debug) {
         std::cout << "Extracting parens..." << std::endl;
     }
 
-    std::vector<std::pair<std::string, std::string>> parensMarkerPairs{
-        std::make_pair("\\(", "\\)"),
-        std::make_pair("\\[", "\\]"),
-        std::make_pair("\\{", "\\}")
-    };
-
-    for (auto marker : parensMarkerPairs) {
-        textBuffer = std::regex_replace(textBuffer, std::regex(marker.first + "(.+?)" + marker.second), " <p> $1 </p> ");
+    for (const auto &paren : re.parens) {
+        textBuffer = std::regex_replace(textBuffer, paren, " <p> $1 </p> ");
     }
 
     // Remove stray markers
@@ -136,35 +181,21 @@ std::vector<std::string> Parser::parseChunk(std::string textBuffer, bool debug)
         std::cout << "Removing stray markers..." << std::endl;
     }
 
-    std::string strayMarkers = "";
-
-    for (auto marker : quoteMarkerPairs) {
-        strayMarkers += marker.first + marker.second;
-    }
-
-    for (auto marker : parensMarkerPairs) {
-        strayMarkers += marker.first + marker.second;
-    }
-
-    textBuffer = std::regex_replace(textBuffer, std::regex("[" + strayMarkers + "]"), " ");
+    textBuffer = std::regex_replace(textBuffer, re.strayMarkers, " ");
 
     // Remove double spaces
     if (debug) {
         std::cout << "Removing double spaces..." << std::endl;
     }
 
-    std::regex doubleSpace_re("  ");
-
-    while (textBuffer.find("  ") != std::string::npos) {
-        textBuffer = std::regex_replace(textBuffer, doubleSpace_re, " ");
-    }
+    Text::collapseSpaces(textBuffer);
 
     // To lowercase
     if (debug) {
         std::cout << "Lowercasing..." << std::endl;
     }
 
-    std::transform(textBuffer.begin(), textBuffer.end(), textBuffer.begin(), ::tolower);
+    Text::lowercase(textBuffer);
 
     if (debug) {
         std::cout << "Vectorizing..." << std::endl;
@@ -10,5 +10,6 @@ class Parser {
 public:
     Parser() = delete;
     static void parse(const std::string &text, std::function<void(std::vector<std::string> &)> callback, std::function<void(void)> done, bool debug = false);
+    static std::vector<std::string> splitParagraphs(const std::string &text);
     static std::vector<std::string> parseChunk(std::string textBuffer, bool debug = false);
 };
@@ -0,0 +1,41 @@
+#ifndef SHINGLES_SCORE_HPP
+#define SHINGLES_SCORE_HPP
+
+#include <cmath>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Log-probabilities (natural log) of scored text, using the same backoff as generation.
+ * Out of vocabulary tokens are counted apart and excluded from the perplexity.
+ */
+struct Score {
+    std::vector<std::pair<std::string, double>> tokens{};
+    double                                      logProbability{0};
+    unsigned long                               count{0};
+    unsigned long                               outOfVocabulary{0};
+
+    void add(const std::string &token, double tokenLogProbability) {
+        tokens.emplace_back(token, tokenLogProbability);
+        logProbability += tokenLogProbability;
+        ++count;
+    }
+
+    void skip(const std::string &token) {
+        tokens.emplace_back(token, -INFINITY);
+        ++outOfVocabulary;
+    }
+
+    void merge(const Score &other) {
+        logProbability += other.logProbability;
+        count += other.count;
+        outOfVocabulary += other.outOfVocabulary;
+    }
+
+    double perplexity() const {
+        return count > 0 ? std::exp(-logProbability / count) : 0;
+    }
+};
+
+#endif //SHINGLES_SCORE_HPP
@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <sstream>
+#include "Topic.hpp"
+#include "Word.hpp"
+
+Topic::Topic(double decay, double threshold) :
+    decayFactor(decay), threshold(threshold) {}
+
+void Topic::decay() {
+    for (auto &entry:entries) {
+        entry.weight *= decayFactor;
+    }
+    entries.erase(
+        std::remove_if(
+            entries.begin(), entries.end(),
+            [this](const Entry &entry) {
+                return entry.weight < threshold;
+            }
+        ),
+        entries.end()
+    );
+}
+
+void Topic::add(const Word *word, double weight) {
+    auto search = std::lower_bound(
+        entries.begin(), entries.end(), word->getId(),
+        [](const Entry &entry, unsigned long id) {
+            return entry.id < id;
+        }
+    );
+    if (search != entries.end() && search->id == word->getId()) {
+        search->weight += weight;
+    } else {
+        entries.insert(search, Entry{word->getId(), word, weight});
+    }
+}
+
+void Topic::clear() {
+    entries.clear();
+}
+
+/**
+ * Pick up new word ids after the dictionary remapped them.
+ */
+void Topic::reorder(unsigned long idsVersion) {
+    if (idsVersion == this->idsVersion) {
+        return;
+    }
+    this->idsVersion = idsVersion;
+    for (auto &entry:entries) {
+        entry.id = entry.word->getId();
+    }
+    std::sort(
+        entries.begin(), entries.end(),
+        [](const Entry &a, const Entry &b) {
+            return a.id < b.id;
+        }
+    );
+}
+
+unsigned long Topic::getIdsVersion() const {
+    return idsVersion;
+}
+
+double Topic::weight(unsigned long id) const {
+    auto search = std::lower_bound(
+        entries.begin(), entries.end(), id,
+        [](const Entry &entry, unsigned long id) {
+            return entry.id < id;
+        }
+    );
+    return search != entries.end() && search->id == id ? search->weight : 0;
+}
+
+double Topic::total() const {
+    double total = 0;
+    for (const auto &entry:entries) {
+        total += entry.weight;
+    }
+    return total;
+}
+
+bool Topic::empty() const {
+    return entries.empty();
+}
+
+Topic::const_iterator Topic::begin() const {
+    return entries.begin();
+}
+
+Topic::const_iterator Topic::end() const {
+    return entries.end();
+}
+
+const std::string Topic::toString() const {
+    std::stringstream ss;
+    for (const auto &entry:entries) {
+        ss << entry.word->getInputText() << ":" << entry.weight << " ";
+    }
+    return ss.str();
+}
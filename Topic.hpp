@@ -0,0 +1,45 @@
+#ifndef SHINGLES_TOPIC_HPP
+#define SHINGLES_TOPIC_HPP
+
+#include <string>
+#include <vector>
+
+class Word;
+
+/**
+ * Weighted topic words of a conversation, kept sorted by word id so that they can be
+ * matched against a gram's children (also ordered by id) in a single merge pass.
+ * Weights decay every turn so that older topics fade out.
+ */
+class Topic {
+public:
+    struct Entry {
+        unsigned long id;
+        const Word    *word;
+        double        weight;
+    };
+
+    using const_iterator = std::vector<Entry>::const_iterator;
+
+    explicit Topic(double decay = 0.5, double threshold = 0.1);
+    void decay();
+    void add(const Word *word, double weight = 1.0);
+    void clear();
+    void reorder(unsigned long idsVersion);
+    unsigned long getIdsVersion() const;
+    double weight(unsigned long id) const;
+    double total() const;
+    bool empty() const;
+    const_iterator begin() const;
+    const_iterator end() const;
+    const std::string toString() const;
+
+private:
+    double             decayFactor{0.5};
+    double             threshold{0.1};
+    // Version of the dictionary word ids the entries are sorted by, see Dictionary::remapIds
+    unsigned long      idsVersion{0};
+    std::vector<Entry> entries{};
+};
+
+#endif //SHINGLES_TOPIC_HPP
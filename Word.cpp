@@ -19,6 +19,10 @@ unsigned long Word::getId() const {
     return id;
 }
 
+void Word::setId(unsigned long id) {
+    this->id = id;
+}
+
 bool Word::isMarker() const {
     return beginMarker != nullptr || endMarker != nullptr;
 }
@@ -49,11 +53,11 @@ void Word::setAsEndMarker(const Word *begin) {
     endMarker   = nullptr;
 }
 
-const std::string Word::getInputText() const {
+const std::string &Word::getInputText() const {
     return inputText;
 }
 
-const std::string Word::getOutputText() const {
+const std::string &Word::getOutputText() const {
     return outputText;
 }
 
@@ -61,6 +65,10 @@ const Gram *Word::getGram() const {
     return &gram;
 }
 
+Gram *Word::getGram() {
+    return &gram;
+}
+
 const std::string Word::toString() const {
     std::stringstream ss;
     ss << gram.toString();
@@ -76,15 +84,23 @@ const Json::Value Word::toJson() const {
     return wordJson;
 }
 
-void Word::fromJson(const Json::Value &word_json, std::unordered_map<unsigned long, std::unique_ptr<Word>> &wordsById) {
-    const Json::Value gram_json = word_json["gram"];
+void Word::fromJson(const Json::Value &word_json, const std::unordered_map<unsigned long, std::unique_ptr<Word>> &wordsById) {
+    const Json::Value &gram_json = word_json["gram"];
     if (gram_json.empty()) {
         std::cerr << "Missing word gram" << std::endl;
-        throw;
+        throw std::runtime_error("Invalid dictionary");
     }
     gram.fromJson(gram_json, wordsById);
 };
 
+void Word::toBinary(std::string &out) const {
+    gram.toBinary(out);
+}
+
+void Word::fromBinary(BinaryReader &reader, const std::unordered_map<unsigned long, std::unique_ptr<Word>> &wordsById) {
+    gram.fromBinary(reader, wordsById);
+}
+
 /**
  * @static
  * @return
@@ -93,24 +109,31 @@ std::unique_ptr<Word> Word::fromJson(const Json::Value &word_json) {
     const Json::Value id_json = word_json["id"];
     if (id_json.empty()) {
         std::cerr << "Missing word id" << std::endl;
-        throw;
+        throw std::runtime_error("Invalid dictionary");
     }
     const Json::Value inputText_json = word_json["input"];
     if (inputText_json.empty()) {
         std::cerr << "Missing word inputText" << std::endl;
-        throw;
+        throw std::runtime_error("Invalid dictionary");
     }
     const Json::Value outputText_json = word_json["output"];
     if (outputText_json.empty()) {
         std::cerr << "Missing word outputText" << std::endl;
-        throw;
+        throw std::runtime_error("Invalid dictionary");
     }
 
     return std::make_unique<Word>(id_json.asUInt64(), inputText_json.asString(), outputText_json.asString());
 };
 
-void Word::updateGraph(const std::vector<Word *> &sentence, unsigned long position, unsigned long n) {
-    gram.update(sentence, position, n);
+void Word::updateGraph(
+    const std::vector<Word *> &sentence, unsigned long position, unsigned long n, unsigned long increment,
+    CountMinSketch *sketch, unsigned long threshold
+) {
+    gram.update(sentence, position, n, increment, sketch, threshold);
+}
+
+void Word::linkSuffixes() {
+    gram.linkSuffixes();
 }
 
 void Word::updateProbabilities(unsigned long wordCount) {
@@ -119,7 +142,8 @@ void Word::updateProbabilities(unsigned long wordCount) {
 
 std::vector<const Word *> Word::candidates(const std::vector<const Word *> &sentence, unsigned long position) const {
     std::vector<const Gram *> gramCandidates = gram.candidates(sentence, position);
-    std::vector<const Word *> wordCandidates{gramCandidates.size()};
+    std::vector<const Word *> wordCandidates{};
+    wordCandidates.reserve(gramCandidates.size());
 
     for (const auto &g:gramCandidates) {
         wordCandidates.push_back(g->getWord());
@@ -135,7 +159,7 @@ const Word *Word::mostProbable(const std::vector<const Word *> &sentence, unsign
 
 const Word *Word::nextWord(
     const std::vector<const Word *> &sentence, unsigned long position,
-    const std::stack<const Word *> &markerStack, const std::vector<const Word *> topic,
+    const MarkerStack &markerStack, const Topic &topic,
     bool finishSentence, bool debug
 ) const {
     const Gram *g = gram.next(sentence, position, markerStack, topic, finishSentence, debug);
@@ -144,7 +168,7 @@ const Word *Word::nextWord(
 
 const Gram *Word::nextGram(
     const std::vector<const Word *> &sentence, unsigned long position,
-    const std::stack<const Word *> &markerStack, const std::vector<const Word *> topic,
+    const MarkerStack &markerStack, const Topic &topic,
     bool finishSentence, bool debug
 ) const {
     return gram.next(sentence, position, markerStack, topic, finishSentence, debug);
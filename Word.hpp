@@ -16,13 +16,17 @@ public:
     Word(unsigned long id, std::string text);
     Word(unsigned long id, std::string inputText, std::string outputText);
     unsigned long getId() const;
-    const std::string getInputText() const;
-    const std::string getOutputText() const;
+    void setId(unsigned long id);
+    const std::string &getInputText() const;
+    const std::string &getOutputText() const;
     const Gram *getGram() const;
+    Gram *getGram();
     const std::string toString() const;
     const Json::Value toJson() const;
     static std::unique_ptr<Word> fromJson(const Json::Value &word_json);
-    void fromJson(const Json::Value &word_json, std::unordered_map<unsigned long, std::unique_ptr<Word>> &wordsById);
+    void fromJson(const Json::Value &word_json, const std::unordered_map<unsigned long, std::unique_ptr<Word>> &wordsById);
+    void toBinary(std::string &out) const;
+    void fromBinary(BinaryReader &reader, const std::unordered_map<unsigned long, std::unique_ptr<Word>> &wordsById);
     bool isMarker() const;
     bool isBeginMarker() const;
     bool isEndMarker() const;
@@ -30,17 +34,21 @@ public:
     const Word *getEndMarker() const;
     void setAsBeginMarker(const Word *endMarker);
     void setAsEndMarker(const Word *beginMarker);
-    void updateGraph(const std::vector<Word *> &sentence, unsigned long position, unsigned long n);
+    void updateGraph(
+        const std::vector<Word *> &sentence, unsigned long position, unsigned long n, unsigned long increment = 1,
+        CountMinSketch *sketch = nullptr, unsigned long threshold = 0
+    );
+    void linkSuffixes();
     void updateProbabilities(unsigned long wordCount);
     std::vector<const Word *> candidates(const std::vector<const Word *> &sentence, unsigned long position) const;
     const Word *mostProbable(const std::vector<const Word *> &sentence, unsigned long position) const;
     const Word *nextWord(
-        const std::vector<const Word *> &sentence, unsigned long n, const std::stack<const Word *> &markerStack,
-        std::vector<const Word *> topic, bool finishSentence = false, bool debug = false
+        const std::vector<const Word *> &sentence, unsigned long n, const MarkerStack &markerStack,
+        const Topic &topic, bool finishSentence = false, bool debug = false
     ) const;
     const Gram *nextGram(
-        const std::vector<const Word *> &sentence, unsigned long n, const std::stack<const Word *> &markerStack,
-        std::vector<const Word *> topic, bool finishSentence = false, bool debug = false
+        const std::vector<const Word *> &sentence, unsigned long n, const MarkerStack &markerStack,
+        const Topic &topic, bool finishSentence = false, bool debug = false
     ) const;
 
 private:
@@ -1,3 +1,4 @@
+#include <cstring>
 #include <fstream>
 #include <vector>
 #include <chrono>
@@ -5,10 +6,15 @@
 #include "linenoise.h"
 #include "utils/split.hpp"
 #include "utils/color.hpp"
+#include "utils/number.hpp"
+#include "utils/parallel.hpp"
 #include "Parser.hpp"
 #include "Dictionary.hpp"
+#include "Blend.hpp"
 
 std::unique_ptr<Dictionary> dictionary{nullptr};
+// Set with --blend, generates and completes in place of the dictionary
+std::unique_ptr<Blend>      blend{nullptr};
 
 struct Arg : public option::Arg {
     static void printError(const char *msg1, const option::Option &opt, const char *msg2) {
@@ -47,17 +53,51 @@ struct Arg : public option::Arg {
         if (msg) printError("Option '", option, "' requires a numeric argument\n");
         return option::ARG_ILLEGAL;
     }
+
+    static option::ArgStatus Count(const option::Option &option, bool msg) {
+        unsigned long value;
+        if (option.arg != 0 && parseCount(option.arg, value))
+            return option::ARG_OK;
+
+        if (msg) printError("Option '", option, "' requires a count greater than zero\n");
+        return option::ARG_ILLEGAL;
+    }
+
+    static option::ArgStatus Real(const option::Option &option, bool msg) {
+        double value;
+        if (option.arg != 0 && parseNumber(option.arg, value) && value >= 0)
+            return option::ARG_OK;
+
+        if (msg) printError("Option '", option, "' requires a number of zero or more\n");
+        return option::ARG_ILLEGAL;
+    }
 };
 
 enum optionIndex {
-    UNKNOWN, HELP, NGRAM, DICTIONARY, FILE_INPUT, INTERACTIVE, VERBOSE
+    UNKNOWN, HELP, NGRAM, DICTIONARY, FILE_INPUT, SCORE, GENERATE, BEST_OF, BEAM, TOPIC_WEIGHT, SKETCH, DEDUP, DECAY, BUILD, MEMORY, MERGE, OUTPUT, BLEND, THREADS, BENCHMARK, INTERACTIVE, VERBOSE
 };
 const option::Descriptor usage[] = {
         {UNKNOWN,     0, "",  "",            Arg::None,     "USAGE: shingles [options]\n\nOptions:"},
         {HELP,        0, "h", "help",        Arg::None,     "  -h, --help  \tPrint usage and exit."},
         {NGRAM,       0, "n", "ngram",       Arg::Numeric,  "  -n, --ngram  \tn-gram depth."},
-        {DICTIONARY,  0, "d", "dictionary",  Arg::Required, "  -d <file>, --dictionary=<file>  \tLoad the dictionary JSON file."},
-        {FILE_INPUT,  0, "f", "file",        Arg::Required, "  -f <file>, --file=<file>  \tIngest the file."},
+        {DICTIONARY,  0, "d", "dictionary",  Arg::Required, "  -d <file>, --dictionary=<file>  \tLoad a dictionary file, binary or JSON."},
+        {FILE_INPUT,  0, "f", "file",        Arg::Required, "  -f <file>[:<weight>], --file=<file>[:<weight>]  \tIngest a file, directory, glob or @list, - for standard input, counting its sentences <weight> times. Also --ingest."},
+        {FILE_INPUT,  0, "",  "ingest",      Arg::Required, 0},
+        {SCORE,       0, "",  "score",       Arg::Required, "  --score=<file>  \tScore each line of the file, printing log-probabilities and perplexity."},
+        {GENERATE,    0, "g", "generate",    Arg::Numeric,  "  -g <count>, --generate=<count>  \tGenerate sentences and exit."},
+        {BEST_OF,     0, "",  "best",        Arg::Count,    "  --best=<count>  \tSample candidates in parallel and keep the most probable."},
+        {BEAM,        0, "",  "beam",        Arg::Count,    "  --beam=<width>  \tGenerate with a beam search of the given width."},
+        {TOPIC_WEIGHT,0, "",  "topic-weight",Arg::Real,     "  --topic-weight=<weight>  \tWeight of topic coverage when ranking candidates."},
+        {SKETCH,      0, "",  "sketch",      Arg::Count,    "  --sketch=<count>  \tKeep grams of order 3 and up once seen <count> times while ingesting."},
+        {DEDUP,       0, "",  "dedup",       Arg::Count,    "  --dedup=<copies>  \tCount at most <copies> copies of a sentence while ingesting, 1 to skip all duplicates."},
+        {DECAY,       0, "",  "decay",       Arg::Real,     "  --decay=<factor>  \tMultiply the counts of the dictionary by <factor> before ingesting, so that new text weighs more."},
+        {BUILD,       0, "",  "build",       Arg::Required, "  --build=<file>  \tCount the ingested files on disk and write them as a binary dictionary."},
+        {MEMORY,      0, "",  "memory",      Arg::Numeric,  "  --memory=<MB>  \tMemory used by --build and --merge before spilling to disk, 1024 by default."},
+        {MERGE,       0, "",  "merge",       Arg::None,     "  --merge <files>  \tMerge the dictionaries, summing their counts, into the -o file."},
+        {OUTPUT,      0, "o", "output",      Arg::Required, "  -o <file>, --output=<file>  \tBinary dictionary written by --merge."},
+        {BLEND,       0, "",  "blend",       Arg::Required, "  --blend=<file>[:<weight>]  \tGenerate from a weighted mix of dictionaries, one option per dictionary."},
+        {THREADS,     0, "t", "threads",     Arg::Numeric,  "  -t <count>, --threads=<count>  \tNumber of threads, defaults to the hardware threads."},
+        {BENCHMARK,   0, "",  "benchmark",   Arg::None,     "  --benchmark  \tBenchmark the loaded dictionary and exit."},
         {INTERACTIVE, 0, "i", "interactive", Arg::None,     "  -i, --interactive  \tInteractive console."},
         {VERBOSE,     0, "v", "verbose",     Arg::None,     "  -v, --verbose  \tVerbose mode."},
         {0,           0, 0,   0,             0,             0}
@@ -67,7 +107,7 @@ char *hints(const char *buf, int *color, int *bold) {
     std::string buffer(buf);
     if ( !buffer.empty() ) {
         //TODO: Autocomplete current word if buffer.back() != ' '
-        std::string hint = dictionary->nextMostProbableWord(buffer);
+        std::string hint = blend ? blend->nextMostProbableWord(buffer) : dictionary->nextMostProbableWord(buffer);
         if (!hint.empty()) {
             *color = Color::FG_DARK_GRAY;
             *bold = 0;
@@ -80,21 +120,61 @@ char *hints(const char *buf, int *color, int *bold) {
 void completion(const char *buf, linenoiseCompletions *lc) {
     std::string buffer(buf);
     if ( !buffer.empty() ) {
-        const std::vector<const std::string> words = dictionary->nextCandidateWords(buffer);
+        const std::vector<std::string> words = blend ? blend->nextCandidateWords(buffer) : dictionary->nextCandidateWords(buffer);
         for (auto w:words) {
             linenoiseAddCompletion(lc, (buffer + (buffer.back() != ' ' ? " " : "") + w).c_str());
         }
     }
 }
 
+/**
+ * Time updateProbabilities with 1, 2, 4... threads up to the available threads
+ * and single threaded generation throughput.
+ */
+void benchmark() {
+    const unsigned int maxThreads = threadCount();
+    const int          runs       = 5;
+
+    std::cout << "Probabilities update:" << std::endl;
+    double baseline = 0;
+    for (unsigned int threads = 1;; threads = std::min(threads * 2, maxThreads)) {
+        parallelism() = threads;
+        double best = 0;
+        for (int run = 0; run < runs; ++run) {
+            auto start = std::chrono::high_resolution_clock::now();
+            dictionary->updateProbabilities();
+            double delta = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+            best = run == 0 ? delta : std::min(best, delta);
+        }
+        if (threads == 1) {
+            baseline = best;
+        }
+        std::cout << "    " << threads << " threads: " << best << "ms (x" << (best > 0 ? baseline / best : 0) << ")" << std::endl;
+        if (threads == maxThreads) {
+            break;
+        }
+    }
+    parallelism() = maxThreads;
+
+    std::cout << "Generation:" << std::endl;
+    const int   sentences = 1000;
+    std::string sentence{};
+    auto        start     = std::chrono::high_resolution_clock::now();
+    for (int i = 0; i < sentences; ++i) {
+        dictionary->generate(Topic{}, "", sentence);
+    }
+    double delta = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    std::cout << "    " << sentences << " sentences: " << delta << "ms (" << (sentences * 1000.0 / delta) << " sentences/s)" << std::endl;
+}
+
 int main(int argc, char *argv[]) {
     // skip program name argv[0] if present
     argc -= (argc > 0);
     argv += (argc > 0);
-    option::Stats stats(usage, argc, argv);
+    option::Stats stats(true, usage, argc, argv);
     std::vector<option::Option> options(stats.options_max);
     std::vector<option::Option> buffer(stats.buffer_max);
-    option::Parser parse(usage, argc, argv, &options[0], &buffer[0]);
+    option::Parser parse(true, usage, argc, argv, &options[0], &buffer[0]);
 
     if (parse.error())
         return 1;
@@ -107,12 +187,37 @@ int main(int argc, char *argv[]) {
     for (option::Option *opt = options[UNKNOWN]; opt; opt = opt->next())
         std::cout << "Unknown option: " << opt->name << "\n";
 
-    for (int i = 0; i < parse.nonOptionsCount(); ++i)
-        std::cout << "Non-option #" << i << ": " << parse.nonOption(i) << "\n";
+    if (!options[MERGE]) {
+        for (int i = 0; i < parse.nonOptionsCount(); ++i)
+            std::cout << "Non-option #" << i << ": " << parse.nonOption(i) << "\n";
+    }
+
+    if (options[THREADS]) {
+        parallelism() = static_cast<unsigned int>(std::stoul(options[THREADS].arg));
+    }
+
+    if (options[BUILD] && (options[DICTIONARY] || options[MERGE])) {
+        std::cerr << "--build starts a new dictionary, it can't be combined with -d or --merge" << std::endl;
+        return 1;
+    }
 
     // Create the dictionary
 
-    if (options[DICTIONARY]) {
+    if (options[MERGE]) {
+        if (!options[OUTPUT] || parse.nonOptionsCount() == 0) {
+            std::cerr << "Usage: shingles --merge <files> -o <file>" << std::endl;
+            return 1;
+        }
+        std::vector<std::string> inputs(parse.nonOptions(), parse.nonOptions() + parse.nonOptionsCount());
+        unsigned long            memory = options[MEMORY] ? std::stoul(options[MEMORY].arg) : 1024;
+        dictionary = std::make_unique<Dictionary>();
+        dictionary->merge(inputs, options[OUTPUT].arg, memory * 1048576);
+        if (!(options[FILE_INPUT] || options[SCORE] || options[BENCHMARK] || options[GENERATE] || options[INTERACTIVE])) {
+            return 0;
+        }
+        dictionary = std::make_unique<Dictionary>();
+        dictionary->open(options[OUTPUT].arg);
+    } else if (options[DICTIONARY]) {
         dictionary = std::make_unique<Dictionary>();
         dictionary->open(options[DICTIONARY].arg);
     } else {
@@ -128,85 +233,248 @@ int main(int argc, char *argv[]) {
         dictionary->setDebug(true);
     }
 
+    if (options[BEST_OF]) {
+        dictionary->setBestOf(std::stoul(options[BEST_OF].arg));
+    }
+
+    if (options[BEAM]) {
+        dictionary->setBeamWidth(std::stoul(options[BEAM].arg));
+    }
+
+    if (options[TOPIC_WEIGHT]) {
+        dictionary->setTopicWeight(std::stod(options[TOPIC_WEIGHT].arg));
+    }
+
+    if (options[SKETCH]) {
+        dictionary->setSketch(std::stoul(options[SKETCH].arg));
+    }
+
+    if (options[DEDUP]) {
+        dictionary->setDedup(std::stoul(options[DEDUP].arg));
+    }
+
+    if (options[DECAY]) {
+        dictionary->decay(std::stod(options[DECAY].arg));
+    }
+
     if (options[FILE_INPUT]) {
-        dictionary->ingestFile(options[FILE_INPUT].arg);
+        std::vector<std::string> files{};
+        for (option::Option *opt = options[FILE_INPUT]; opt; opt = opt->next()) {
+            files.emplace_back(opt->arg);
+        }
+        if (options[BUILD]) {
+            unsigned long memory = options[MEMORY] ? std::stoul(options[MEMORY].arg) : 1024;
+            dictionary->build(files, options[BUILD].arg, memory * 1048576);
+            // Only the vocabulary is in memory, load the grams if they are going to be used
+            if (options[SCORE] || options[BENCHMARK] || options[GENERATE] || options[INTERACTIVE]) {
+                dictionary->open(options[BUILD].arg);
+            }
+        } else {
+            dictionary->ingestFiles(files);
+        }
+    }
+
+    if (options[BLEND]) {
+        blend = std::make_unique<Blend>();
+        for (option::Option *opt = options[BLEND]; opt; opt = opt->next()) {
+            std::string path   = opt->arg;
+            double      weight = 1;
+            size_t      colon  = path.rfind(':');
+            if (colon != std::string::npos && parseNumber(path.substr(colon + 1), weight)) {
+                if (weight <= 0) {
+                    std::cerr << "Invalid blend weight: " << opt->arg << std::endl;
+                    return 1;
+                }
+                path.resize(colon);
+            }
+            std::unique_ptr<Dictionary> part = std::make_unique<Dictionary>();
+            if (!part->open(path)) {
+                std::cerr << "Can't blend " << path << std::endl;
+                return 1;
+            }
+            blend->add(std::move(part), weight);
+        }
+        std::cout << "Generating from a blend of " << options[BLEND].count() << " dictionaries: typed text is not learned,"
+                  << " and the topic, best-of and beam search are not used" << std::endl;
+    }
+
+    if (options[SCORE]) {
+        dictionary->scoreFile(options[SCORE].arg);
+    }
+
+    if (options[BENCHMARK]) {
+        benchmark();
+    }
+
+    if (options[GENERATE]) {
+        unsigned long count = std::stoul(options[GENERATE].arg);
+        std::string   sentence{};
+        for (unsigned long i = 0; i < count; ++i) {
+            if (blend) {
+                sentence = blend->generate();
+            } else {
+                dictionary->generate(Topic{}, "", sentence);
+            }
+            std::cout << sentence << std::endl;
+        }
     }
 
     if (options[INTERACTIVE]) {
         std::cout << "User :h or :help to see a list of commands." << std::endl;
 
+        // Topic of the conversation, fading out over turns
+        Topic topic{};
+
         char *line;
         linenoiseHistorySetMaxLen(32);
         linenoiseSetHintsCallback(hints);
         linenoiseSetCompletionCallback(completion);
         while ((line = linenoise("human: ")) != nullptr) {
             const std::string line_str = std::string(line);
-            if (line_str[0] == ':') {
-                std::vector<std::string> input = split(line_str.substr(1, std::string::npos), ' ');
-                if (input.size() > 0) {
-                    const std::string &command = input[0];
-                    std::vector<std::string> arguments = std::vector<std::string>(input.cbegin() + 1, input.cend());
-                    const std::string arguments_str =
-                            arguments.size() > 0 ? line_str.substr(command.size() + 2, std::string::npos) : "";
-
-                    if (command == "h" || command == "help") {
-                        std::cout << ":h, :help                          This command" << std::endl;
-                        std::cout << ":d, :debug                         Toggle (extremely) verbose debug output" << std::endl;
-                        std::cout << ":s <filename>, :save <filename>    Save the dictionary file" << std::endl;
-                        std::cout << ":o <filename>, :open <filename>    Open a dictionary file" << std::endl;
-                        std::cout << ":i <filename>, :ingest <filename>  Ingest/learn a text file" << std::endl;
-                        std::cout << std::endl;
-                        std::cout << ">        Seed the sentence generation with text entered after the >" << std::endl;
-                        std::cout << "<enter>  Generate a new sentence" << std::endl;
-                        std::cout << "<tab>    Autocomplete" << std::endl;
-                        std::cout << std::endl;
-                        std::cout << "Otherwise, type some text then press <enter> to ingest/learn that text before generating a new sentence" << std::endl;
-                        std::cout << std::endl;
-
-                    } else if (command == "s" || command == "save") {
-                        if (arguments.size() == 1) {
-                            dictionary->save(arguments[0]);
-                        } else {
-                            std::cerr << "Invalid number of arguments" << std::endl;
-                        }
-                    } else if (command == "o" || command == "open") {
-                        if (arguments.size() == 1) {
-                            dictionary->open(arguments[0]);
-                        } else {
-                            std::cerr << "Invalid number of arguments" << std::endl;
-                        }
-                    } else if (command == "i" || command == "ingest") {
-                        if (arguments.size() == 1) {
-                            dictionary->ingestFile(arguments[0]);
+            // A failing command reports its error, the conversation goes on
+            try {
+                if (line_str[0] == ':') {
+                    std::vector<std::string> input = split(line_str.substr(1, std::string::npos), ' ');
+                    if (input.size() > 0) {
+                        const std::string &command = input[0];
+                        std::vector<std::string> arguments = std::vector<std::string>(input.cbegin() + 1, input.cend());
+                        const std::string arguments_str =
+                                arguments.size() > 0 ? line_str.substr(command.size() + 2, std::string::npos) : "";
+
+                        if (command == "h" || command == "help") {
+                            std::cout << ":h, :help                          This command" << std::endl;
+                            std::cout << ":d, :debug                         Toggle (extremely) verbose debug output" << std::endl;
+                            std::cout << ":s <filename>, :save <filename>    Save the dictionary file, as JSON if named *.json" << std::endl;
+                            std::cout << ":o <filename>, :open <filename>    Open a dictionary file" << std::endl;
+                            std::cout << ":i <files...>, :ingest <files...>  Ingest/learn text files, directories or @lists, <file>:<weight> to weigh them" << std::endl;
+                            std::cout << ":weight <weight>                   Count the text typed in <weight> times" << std::endl;
+                            std::cout << ":decay <factor>                    Multiply all counts by <factor>, so that new text weighs more" << std::endl;
+                            std::cout << ":t, :topic                         Show the conversation topic" << std::endl;
+                            std::cout << ":score <text>                      Score the text against the dictionary" << std::endl;
+                            std::cout << ":best <count>                      Sample <count> candidates and keep the most probable" << std::endl;
+                            std::cout << ":beam <width>                      Generate with a beam search, 1 to turn off" << std::endl;
+                            std::cout << ":topic-weight <weight>             Weight of topic coverage when ranking candidates" << std::endl;
+                            std::cout << std::endl;
+                            std::cout << "With --blend, typed text is not learned and the topic, :best and :beam are not used." << std::endl;
+                            std::cout << std::endl;
+                            std::cout << ">        Seed the sentence generation with text entered after the >" << std::endl;
+                            std::cout << "<enter>  Generate a new sentence" << std::endl;
+                            std::cout << "<tab>    Autocomplete" << std::endl;
+                            std::cout << std::endl;
+                            std::cout << "Otherwise, type some text then press <enter> to ingest/learn that text before generating a new sentence" << std::endl;
+                            std::cout << std::endl;
+
+                        } else if (command == "s" || command == "save") {
+                            if (arguments.size() == 1) {
+                                dictionary->save(arguments[0]);
+                            } else {
+                                std::cerr << "Invalid number of arguments" << std::endl;
+                            }
+                        } else if (command == "o" || command == "open") {
+                            if (arguments.size() == 1) {
+                                dictionary->open(arguments[0]);
+                                topic.clear();
+                            } else {
+                                std::cerr << "Invalid number of arguments" << std::endl;
+                            }
+                        } else if (command == "i" || command == "ingest") {
+                            if (!arguments.empty()) {
+                                dictionary->ingestFiles(arguments);
+                            } else {
+                                std::cerr << "Invalid number of arguments" << std::endl;
+                            }
+                        } else if (command == "weight") {
+                            double weight;
+                            if (arguments.size() != 1) {
+                                std::cerr << "Invalid number of arguments" << std::endl;
+                            } else if (!parseNumber(arguments[0], weight)) {
+                                std::cerr << "Invalid weight: " << arguments[0] << std::endl;
+                            } else {
+                                dictionary->setInputWeight(weight);
+                            }
+                        } else if (command == "decay") {
+                            double factor;
+                            if (arguments.size() != 1) {
+                                std::cerr << "Invalid number of arguments" << std::endl;
+                            } else if (!parseNumber(arguments[0], factor)) {
+                                std::cerr << "Invalid decay factor: " << arguments[0] << std::endl;
+                            } else {
+                                dictionary->decay(factor);
+                            }
+                        } else if (command == "t" || command == "topic") {
+                            std::cout << "Topic: " << topic.toString() << std::endl;
+                        } else if (command == "score") {
+                            if (!arguments.empty()) {
+                                Score score = dictionary->score(arguments_str);
+                                for (const auto &token:score.tokens) {
+                                    std::cout << Color::FG_YELLOW << token.second << Color::FG_DEFAULT << "\t"
+                                              << Color::FG_LIGHT_GRAY << token.first << Color::FG_DEFAULT << std::endl;
+                                }
+                                std::cout << "Log-probability: " << score.logProbability
+                                          << ", perplexity: " << score.perplexity()
+                                          << " (" << score.count << " tokens, " << score.outOfVocabulary << " out of vocabulary)"
+                                          << std::endl;
+                            } else {
+                                std::cerr << "Invalid number of arguments" << std::endl;
+                            }
+                        } else if (command == "best") {
+                            unsigned long bestOf;
+                            if (arguments.size() != 1) {
+                                std::cerr << "Invalid number of arguments" << std::endl;
+                            } else if (!parseCount(arguments[0], bestOf)) {
+                                std::cerr << "Invalid count: " << arguments[0] << std::endl;
+                            } else {
+                                dictionary->setBestOf(bestOf);
+                            }
+                        } else if (command == "beam") {
+                            unsigned long beamWidth;
+                            if (arguments.size() != 1) {
+                                std::cerr << "Invalid number of arguments" << std::endl;
+                            } else if (!parseCount(arguments[0], beamWidth)) {
+                                std::cerr << "Invalid width: " << arguments[0] << std::endl;
+                            } else {
+                                dictionary->setBeamWidth(beamWidth);
+                            }
+                        } else if (command == "topic-weight") {
+                            double topicWeight;
+                            if (arguments.size() != 1) {
+                                std::cerr << "Invalid number of arguments" << std::endl;
+                            } else if (!parseNumber(arguments[0], topicWeight) || topicWeight < 0) {
+                                std::cerr << "Invalid weight: " << arguments[0] << std::endl;
+                            } else {
+                                dictionary->setTopicWeight(topicWeight);
+                            }
+                        } else if (command == "d" || command == "debug") {
+                            dictionary->setDebug();
                         } else {
-                            std::cerr << "Invalid number of arguments" << std::endl;
+                            std::cerr << "Unknown command" << std::endl;
                         }
-                    } else if (command == "d" || command == "debug") {
-                        dictionary->setDebug();
                     } else {
-                        std::cerr << "Unknown command" << std::endl;
+                        std::cerr << "Please enter a command" << std::endl;
                     }
-                } else {
-                    std::cerr << "Please enter a command" << std::endl;
-                }
-            } else if (line_str[0] == '>') {
-                std::string wisdom = dictionary->generate("", line_str.substr(1, std::string::npos));
-                std::cout << Color::FG_MAGENTA << "shingles"
-                          << Color::FG_DARK_GRAY << ": "
-                          << Color::FG_DEFAULT
-                          << wisdom
-                          << std::endl;
+                } else if (line_str[0] == '>') {
+                    std::string seed   = line_str.substr(1, std::string::npos);
+                    std::string wisdom = blend ? blend->generate(seed) : dictionary->generate(topic, seed);
+                    std::cout << Color::FG_MAGENTA << "shingles"
+                              << Color::FG_DARK_GRAY << ": "
+                              << Color::FG_DEFAULT
+                              << wisdom
+                              << std::endl;
 
-            } else {
-                if (line_str.size() > 0) {
-                    dictionary->input(line_str);
+                } else {
+                    if (line_str.size() > 0 && !blend) {
+                        dictionary->input(line_str);
+                    }
+                    dictionary->updateTopic(topic, line_str);
+                    std::string wisdom = blend ? blend->generate() : dictionary->generate(topic);
+                    std::cout<< Color::FG_MAGENTA << "shingles"
+                             << Color::FG_DARK_GRAY << ": "
+                             << Color::FG_DEFAULT
+                             << wisdom
+                             << std::endl;
                 }
-                std::string wisdom = dictionary->generate(line_str);
-                std::cout<< Color::FG_MAGENTA << "shingles"
-                         << Color::FG_DARK_GRAY << ": "
-                         << Color::FG_DEFAULT
-                         << wisdom
-                         << std::endl;
+            } catch (const std::exception &e) {
+                std::cerr << e.what() << std::endl;
             }
 
             linenoiseHistoryAdd(line);
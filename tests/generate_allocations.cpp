@@ -0,0 +1,64 @@
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <string>
+#include "Dictionary.hpp"
+#include "Parser.hpp"
+
+/**
+ * Steady-state generation must not allocate: every heap allocation of the process is counted while
+ * sentences are generated into a reused string, once the per-thread scratch buffers are warmed up.
+ */
+
+static std::atomic<unsigned long> allocations{0};
+
+void *operator new(std::size_t size) {
+    ++allocations;
+    if (void *p = std::malloc(size > 0 ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+int main() {
+    static const unsigned long warmUp    = 1000;
+    static const unsigned long sentences = 10000;
+
+    // Sentences of a word from each of three disjoint sets, so that every generated sentence has the
+    // same length and warming up reaches the final capacity of the buffers
+    std::string corpus{};
+    for (unsigned long i = 0; i < 2000; ++i) {
+        corpus += "alpha" + std::to_string(i % 37) + " beta" + std::to_string(i % 41)
+                  + " gamma" + std::to_string(i % 43) + ". ";
+    }
+
+    Dictionary dictionary(3);
+    std::vector<std::string> words = Parser::parseChunk(corpus);
+    dictionary.ingest(words);
+    dictionary.updateProbabilities();
+
+    const Topic topic{};
+    std::string sentence{};
+    sentence.reserve(256);
+    for (unsigned long i = 0; i < warmUp; ++i) {
+        dictionary.generate(topic, "", sentence);
+    }
+
+    unsigned long before = allocations;
+    for (unsigned long i = 0; i < sentences; ++i) {
+        dictionary.generate(topic, "", sentence);
+    }
+    unsigned long counted = allocations - before;
+
+    std::cout << counted << " allocations while generating " << sentences << " sentences, last: " << sentence << std::endl;
+    return counted == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
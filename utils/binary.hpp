@@ -0,0 +1,98 @@
+#ifndef SHINGLES_BINARY_HPP
+#define SHINGLES_BINARY_HPP
+
+#include <istream>
+#include <stdexcept>
+#include <string>
+
+/**
+ * LEB128-style variable length integers: 7 bits per byte, high bit set on all but the last byte.
+ */
+inline void writeVarint(std::string &out, unsigned long value) {
+    while (value >= 0x80) {
+        out += static_cast<char>((value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    out += static_cast<char>(value);
+}
+
+inline void writeString(std::string &out, const std::string &value) {
+    writeVarint(out, value.size());
+    out += value;
+}
+
+// Same encodings read from a stream, for files too big to be read at once
+
+inline unsigned long readVarint(std::istream &in) {
+    unsigned long value = 0;
+    unsigned int  shift = 0;
+    while (true) {
+        int byte = in.get();
+        if (byte == std::char_traits<char>::eof() || shift > 63) {
+            throw std::runtime_error("Truncated varint");
+        }
+        value |= static_cast<unsigned long>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+        shift += 7;
+    }
+}
+
+inline std::string readString(std::istream &in) {
+    std::string value(readVarint(in), '\0');
+    if (!value.empty() && !in.read(&value[0], value.size())) {
+        throw std::runtime_error("Truncated string");
+    }
+    return value;
+}
+
+class BinaryReader {
+public:
+    BinaryReader(const char *begin, const char *end) : cursor(begin), end(end) {}
+
+    unsigned long varint() {
+        unsigned long value = 0;
+        unsigned int  shift = 0;
+        while (true) {
+            if (cursor == end || shift > 63) {
+                throw std::runtime_error("Truncated varint");
+            }
+            auto byte = static_cast<unsigned char>(*cursor++);
+            value |= static_cast<unsigned long>(byte & 0x7F) << shift;
+            if ((byte & 0x80) == 0) {
+                return value;
+            }
+            shift += 7;
+        }
+    }
+
+    std::string string() {
+        unsigned long size = varint();
+        if (static_cast<unsigned long>(end - cursor) < size) {
+            throw std::runtime_error("Truncated string");
+        }
+        std::string value(cursor, size);
+        cursor += size;
+        return value;
+    }
+
+    BinaryReader block(unsigned long size) {
+        if (static_cast<unsigned long>(end - cursor) < size) {
+            throw std::runtime_error("Truncated block");
+        }
+        BinaryReader reader(cursor, cursor + size);
+        cursor += size;
+        return reader;
+    }
+
+    bool atEnd() const {
+        return cursor == end;
+    }
+
+private:
+    const char *cursor;
+    const char *end;
+};
+
+#endif //SHINGLES_BINARY_HPP
@@ -0,0 +1,71 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <dirent.h>
+#include <glob.h>
+#include <sys/stat.h>
+#include "files.hpp"
+
+static void walk(const std::string &path, std::vector<std::string> &files) {
+    struct stat info{};
+    if (stat(path.c_str(), &info) != 0) {
+        std::cerr << "File not found: " << path << std::endl;
+        return;
+    }
+
+    if (S_ISREG(info.st_mode)) {
+        files.push_back(path);
+    } else if (S_ISDIR(info.st_mode)) {
+        DIR *dir = opendir(path.c_str());
+        if (dir == nullptr) {
+            std::cerr << "Can't read directory: " << path << std::endl;
+            return;
+        }
+
+        std::vector<std::string> entries{};
+        while (struct dirent *entry = readdir(dir)) {
+            std::string name(entry->d_name);
+            // Skip hidden files along with . and ..
+            if (name[0] != '.') {
+                entries.push_back(path + (path.back() == '/' ? "" : "/") + name);
+            }
+        }
+        closedir(dir);
+
+        std::sort(entries.begin(), entries.end());
+        for (const auto &entry:entries) {
+            walk(entry, files);
+        }
+    }
+}
+
+std::vector<std::string> listFiles(const std::string &pattern) {
+    std::vector<std::string> files{};
+
+    if (!pattern.empty() && pattern[0] == '@') {
+        std::ifstream list(pattern.substr(1));
+        if (!list) {
+            std::cerr << "File list not found: " << pattern.substr(1) << std::endl;
+            return files;
+        }
+        std::string line;
+        while (std::getline(list, line)) {
+            if (!line.empty()) {
+                for (const auto &file:listFiles(line)) {
+                    files.push_back(file);
+                }
+            }
+        }
+        return files;
+    }
+
+    glob_t matches{};
+    if (glob(pattern.c_str(), GLOB_NOCHECK, nullptr, &matches) == 0) {
+        for (size_t i = 0; i < matches.gl_pathc; ++i) {
+            walk(matches.gl_pathv[i], files);
+        }
+    }
+    globfree(&matches);
+
+    return files;
+}
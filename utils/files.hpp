@@ -0,0 +1,11 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/**
+ * Expand a path pattern to the regular files it designates:
+ * glob patterns are expanded, directories are walked recursively
+ * and @list.txt reads one pattern per line from list.txt.
+ */
+std::vector<std::string> listFiles(const std::string &pattern);
@@ -0,0 +1,112 @@
+#ifndef SHINGLES_INTERN_HPP
+#define SHINGLES_INTERN_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Concurrent string interning, find or insert from any number of threads.
+ * Keys are spread over lock-striped open addressing tables, so threads only contend when they hit
+ * the same stripe at the same time. Values are pointers whose key is read back with KeyOf, so keys
+ * are not copied: a slot is a hash and a pointer. A missing value is made by the factory passed
+ * to intern, under the stripe lock, so every key is made exactly once.
+ */
+template<typename T, typename KeyOf>
+class InternTable {
+public:
+    InternTable() : stripes(new Stripe[stripeCount]) {}
+
+    template<typename Make>
+    T intern(const std::string &key, Make make) {
+        uint64_t                    h      = hash(key);
+        Stripe                      &stripe = stripes[h % stripeCount];
+        std::lock_guard<std::mutex> lock(stripe.mutex);
+
+        if (stripe.slots.empty()) {
+            grow(stripe);
+        }
+        size_t slot = probe(stripe, h, key);
+        if (stripe.slots[slot].value == nullptr) {
+            if ((stripe.size + 1) * 4 > stripe.slots.size() * 3) {
+                grow(stripe);
+                slot = probe(stripe, h, key);
+            }
+            stripe.slots[slot] = Slot{h, make()};
+            ++stripe.size;
+        }
+        return stripe.slots[slot].value;
+    }
+
+    void clear() {
+        for (size_t i = 0; i < stripeCount; ++i) {
+            std::lock_guard<std::mutex> lock(stripes[i].mutex);
+            stripes[i].slots.clear();
+            stripes[i].size = 0;
+        }
+    }
+
+private:
+    static const size_t stripeCount = 64;
+
+    struct Slot {
+        uint64_t hash;
+        T        value;
+    };
+
+    // Followed by a cache line of padding, so that threads locking neighbouring stripes never share
+    // a line. Padding rather than alignas, as new[] does not honour over-alignment before C++17.
+    struct Stripe {
+        std::mutex        mutex{};
+        std::vector<Slot> slots{};
+        size_t            size{0};
+        char              padding[64]{};
+    };
+
+    static uint64_t hash(const std::string &key) {
+        // FNV-1a, then the splitmix64 finalizer so that both the stripe and the slot bits are mixed
+        uint64_t h = 0xCBF29CE484222325ULL;
+        for (char c:key) {
+            h ^= static_cast<unsigned char>(c);
+            h *= 0x100000001B3ULL;
+        }
+        h ^= h >> 30;
+        h *= 0xBF58476D1CE4E5B9ULL;
+        h ^= h >> 27;
+        h *= 0x94D049BB133111EBULL;
+        return h ^ (h >> 31);
+    }
+
+    // Slot holding the key, or the empty slot where it goes, linear probing on a power of two table
+    static size_t probe(const Stripe &stripe, uint64_t h, const std::string &key) {
+        size_t mask = stripe.slots.size() - 1;
+        size_t slot = (h / stripeCount) & mask;
+        while (stripe.slots[slot].value != nullptr
+               && (stripe.slots[slot].hash != h || KeyOf()(stripe.slots[slot].value) != key)) {
+            slot = (slot + 1) & mask;
+        }
+        return slot;
+    }
+
+    static void grow(Stripe &stripe) {
+        std::vector<Slot> slots(std::max<size_t>(16, stripe.slots.size() * 2), Slot{0, nullptr});
+        size_t            mask = slots.size() - 1;
+        for (const auto &entry:stripe.slots) {
+            if (entry.value != nullptr) {
+                size_t slot = (entry.hash / stripeCount) & mask;
+                while (slots[slot].value != nullptr) {
+                    slot = (slot + 1) & mask;
+                }
+                slots[slot] = entry;
+            }
+        }
+        stripe.slots.swap(slots);
+    }
+
+    std::unique_ptr<Stripe[]> stripes;
+};
+
+#endif //SHINGLES_INTERN_HPP
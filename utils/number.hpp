@@ -0,0 +1,46 @@
+#ifndef SHINGLES_NUMBER_HPP
+#define SHINGLES_NUMBER_HPP
+
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+
+/**
+ * Parse the whole text as a finite number, false if it is anything else or out of range.
+ * Text accepted here is also safe to give to std::stod.
+ */
+inline bool parseNumber(const std::string &text, double &value) {
+    if (text.empty() || std::isspace(static_cast<unsigned char>(text[0]))) {
+        return false;
+    }
+    char *end = nullptr;
+    errno = 0;
+    double parsed = std::strtod(text.c_str(), &end);
+    if (*end != '\0' || errno == ERANGE || !std::isfinite(parsed)) {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+/**
+ * Parse the whole text as a count greater than zero, false if it is anything else (such as -1,
+ * which strtoul would wrap around). Text accepted here is also safe to give to std::stoul.
+ */
+inline bool parseCount(const std::string &text, unsigned long &value) {
+    if (text.empty() || !std::isdigit(static_cast<unsigned char>(text[0]))) {
+        return false;
+    }
+    char *end = nullptr;
+    errno = 0;
+    unsigned long parsed = std::strtoul(text.c_str(), &end, 10);
+    if (*end != '\0' || errno == ERANGE || parsed == 0) {
+        return false;
+    }
+    value = parsed;
+    return true;
+}
+
+#endif //SHINGLES_NUMBER_HPP
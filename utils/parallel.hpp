@@ -0,0 +1,145 @@
+#ifndef SHINGLES_PARALLEL_HPP
+#define SHINGLES_PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Number of threads used by the parallel helpers, 0 for one per hardware thread.
+ */
+inline unsigned int &parallelism() {
+    static unsigned int threads{0};
+    return threads;
+}
+
+inline unsigned int threadCount() {
+    return parallelism() > 0 ? parallelism() : std::max(1u, std::thread::hardware_concurrency());
+}
+
+/**
+ * Run fn(0) ... fn(size - 1) over one async task per thread.
+ * Tasks pick the next index as they finish so that uneven items balance out.
+ * Exceptions thrown by fn are rethrown once every task is done.
+ */
+inline void parallelFor(unsigned long size, const std::function<void(unsigned long)> &fn) {
+    unsigned long numThreads = std::min<unsigned long>(threadCount(), size);
+
+    if (numThreads <= 1) {
+        for (unsigned long i = 0; i < size; ++i) {
+            fn(i);
+        }
+        return;
+    }
+
+    std::atomic<unsigned long>     next{0};
+    std::vector<std::future<void>> pool{};
+    for (unsigned long t = 0; t < numThreads; ++t) {
+        pool.push_back(
+            std::async(
+                std::launch::async,
+                [&next, &fn, size]() {
+                    for (unsigned long i = next++; i < size; i = next++) {
+                        fn(i);
+                    }
+                }
+            )
+        );
+    }
+
+    for (auto &fut:pool) {
+        fut.wait();
+    }
+    for (auto &fut:pool) {
+        fut.get();
+    }
+}
+
+/**
+ * Run tasks that can spawn more tasks over one worker per thread.
+ * Each worker keeps its own deque, running its newest tasks first and stealing the oldest
+ * (usually biggest) tasks of other workers when it runs out, so that skewed work balances out.
+ * Tasks must not throw.
+ */
+template<typename Task>
+void workSteal(const std::vector<Task> &tasks, const std::function<void(Task &, const std::function<void(Task)> &)> &run) {
+    unsigned long numThreads = threadCount();
+
+    if (numThreads <= 1) {
+        std::vector<Task>               stack(tasks.rbegin(), tasks.rend());
+        const std::function<void(Task)> spawn = [&stack](Task task) {
+            stack.push_back(std::move(task));
+        };
+        while (!stack.empty()) {
+            Task task = std::move(stack.back());
+            stack.pop_back();
+            run(task, spawn);
+        }
+        return;
+    }
+
+    struct Queue {
+        std::mutex       mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<Queue>         queues(numThreads);
+    std::atomic<unsigned long> pending{tasks.size()};
+    for (unsigned long i = 0; i < tasks.size(); ++i) {
+        queues[i % numThreads].tasks.push_back(tasks[i]);
+    }
+
+    auto worker = [&queues, &pending, &run, numThreads](unsigned long self) {
+        const std::function<void(Task)> spawn = [&queues, &pending, self](Task task) {
+            ++pending;
+            std::lock_guard<std::mutex> lock(queues[self].mutex);
+            queues[self].tasks.push_back(std::move(task));
+        };
+
+        while (pending > 0) {
+            Task task{};
+            bool found = false;
+
+            {
+                std::lock_guard<std::mutex> lock(queues[self].mutex);
+                if (!queues[self].tasks.empty()) {
+                    task = std::move(queues[self].tasks.back());
+                    queues[self].tasks.pop_back();
+                    found = true;
+                }
+            }
+
+            for (unsigned long i = 1; i < numThreads && !found; ++i) {
+                Queue                       &victim = queues[(self + i) % numThreads];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (!victim.tasks.empty()) {
+                    task = std::move(victim.tasks.front());
+                    victim.tasks.pop_front();
+                    found = true;
+                }
+            }
+
+            if (found) {
+                run(task, spawn);
+                --pending;
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    };
+
+    std::vector<std::future<void>> pool{};
+    for (unsigned long t = 0; t < numThreads; ++t) {
+        pool.push_back(std::async(std::launch::async, worker, t));
+    }
+    for (auto &fut:pool) {
+        fut.get();
+    }
+}
+
+#endif //SHINGLES_PARALLEL_HPP
@@ -0,0 +1,209 @@
+#ifndef SHINGLES_PERFECT_HASH_HPP
+#define SHINGLES_PERFECT_HASH_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * Minimal perfect hash over a frozen set of strings, hash and displace style (CHD/PTHash).
+ * Keys are spread into buckets of about bucketSize keys, skewed so that 60% of the keys share 30% of
+ * the buckets (big buckets are placed first, while the table is empty), and each bucket stores the 16 bit pilot
+ * that places all of its keys in free slots of a table slightly larger than the key count. The few
+ * keys landing past the end are remapped to the holes left below it, so slots are exactly 0..n-1.
+ * That is about 3 bits per key of index. Keys are kept in a contiguous arena in slot order, so a
+ * lookup is one hash, one probe and one comparison, and unknown keys are rejected.
+ */
+template<typename T>
+class PerfectHash {
+public:
+    // Returns false if no placement was found, the hash is then left empty
+    bool build(const std::vector<std::pair<std::string, T>> &entries) {
+        clear();
+        if (entries.empty()) {
+            return true;
+        }
+        for (uint64_t attempt = 0; attempt < maxAttempts; ++attempt) {
+            if (place(entries, attempt)) {
+                return true;
+            }
+        }
+        clear();
+        return false;
+    }
+
+    T find(const std::string &key) const {
+        if (values.empty()) {
+            return T{};
+        }
+        uint64_t h    = hash(key, hashSeed);
+        size_t   slot = position(h, pilots[bucket(h)]);
+        if (slot >= values.size()) {
+            slot = remap[slot - values.size()];
+        }
+        size_t begin = offsets[slot];
+        size_t size  = offsets[slot + 1] - begin;
+        return size == key.size() && arena.compare(begin, size, key) == 0 ? values[slot] : T{};
+    }
+
+    void clear() {
+        pilots.clear();
+        remap.clear();
+        arena.clear();
+        offsets.clear();
+        values.clear();
+    }
+
+    bool empty() const {
+        return values.empty();
+    }
+
+    size_t size() const {
+        return values.size();
+    }
+
+    // Index overhead, pilots and remapped slots, not counting the keys and values themselves
+    double bitsPerKey() const {
+        return values.empty() ? 0 : (pilots.size() * 16.0 + remap.size() * 32.0) / values.size();
+    }
+
+private:
+    static constexpr double   loadFactor  = 0.99;
+    static constexpr size_t   bucketSize  = 6;
+    static constexpr uint32_t maxPilot    = 0xFFFF;
+    static constexpr uint64_t maxAttempts = 8;
+
+    static uint64_t mix(uint64_t x) {
+        // splitmix64 finalizer
+        x ^= x >> 30;
+        x *= 0xBF58476D1CE4E5B9ULL;
+        x ^= x >> 27;
+        x *= 0x94D049BB133111EBULL;
+        return x ^ (x >> 31);
+    }
+
+    static uint64_t hash(const std::string &key, uint64_t seed) {
+        // FNV-1a
+        uint64_t h = 0xCBF29CE484222325ULL;
+        for (char c:key) {
+            h ^= static_cast<unsigned char>(c);
+            h *= 0x100000001B3ULL;
+        }
+        return mix(h ^ seed);
+    }
+
+    size_t bucket(uint64_t h) const {
+        // Low bits pick the dense or sparse buckets (60% of the keys), high bits the bucket within them
+        if ((h & 0xFFFFFFFF) < 0x99999999ULL) {
+            return static_cast<size_t>(((h >> 32) * denseBuckets) >> 32);
+        }
+        return denseBuckets + static_cast<size_t>(((h >> 32) * (pilots.size() - denseBuckets)) >> 32);
+    }
+
+    size_t position(uint64_t h, uint16_t pilot) const {
+        return static_cast<size_t>(((mix(h ^ (pilot * 0x9E3779B97F4A7C15ULL)) >> 32) * tableSize) >> 32);
+    }
+
+    bool place(const std::vector<std::pair<std::string, T>> &entries, uint64_t attempt) {
+        size_t count = entries.size();
+        hashSeed  = mix(attempt);
+        tableSize = std::max(count, static_cast<size_t>(count / loadFactor) + 1);
+        pilots.assign((count + bucketSize - 1) / bucketSize, 0);
+        denseBuckets = pilots.size() * 3 / 10; // Dense keys go to bucket 0 when there are too few buckets
+
+        std::vector<uint64_t>              hashes(count);
+        std::vector<std::vector<uint32_t>> buckets(pilots.size());
+        for (size_t i = 0; i < count; ++i) {
+            hashes[i] = hash(entries[i].first, hashSeed);
+            buckets[bucket(hashes[i])].push_back(static_cast<uint32_t>(i));
+        }
+
+        // Biggest buckets first, while the table is still mostly empty
+        std::vector<uint32_t> order(buckets.size());
+        for (size_t b = 0; b < order.size(); ++b) {
+            order[b] = static_cast<uint32_t>(b);
+        }
+        std::stable_sort(
+            order.begin(), order.end(),
+            [&buckets](uint32_t a, uint32_t b) {
+                return buckets[a].size() > buckets[b].size();
+            }
+        );
+
+        std::vector<bool>     taken(tableSize, false);
+        std::vector<uint32_t> slots(count);
+        std::vector<size_t>   placed{};
+        for (auto b:order) {
+            const auto &keys = buckets[b];
+            if (keys.empty()) {
+                break;
+            }
+
+            bool found = false;
+            for (uint32_t pilot = 0; pilot <= maxPilot && !found; ++pilot) {
+                placed.clear();
+                found = true;
+                for (auto key:keys) {
+                    size_t slot = position(hashes[key], static_cast<uint16_t>(pilot));
+                    if (taken[slot] || std::find(placed.begin(), placed.end(), slot) != placed.end()) {
+                        found = false;
+                        break;
+                    }
+                    placed.push_back(slot);
+                }
+                if (found) {
+                    pilots[b] = static_cast<uint16_t>(pilot);
+                }
+            }
+            if (!found) {
+                return false;
+            }
+
+            for (size_t i = 0; i < keys.size(); ++i) {
+                taken[placed[i]] = true;
+                slots[keys[i]]   = static_cast<uint32_t>(placed[i]);
+            }
+        }
+
+        // Make it minimal, slots past the key count move to the holes below it
+        remap.assign(tableSize - count, 0);
+        size_t hole = 0;
+        for (size_t slot = count; slot < tableSize; ++slot) {
+            if (taken[slot]) {
+                while (taken[hole]) {
+                    ++hole;
+                }
+                taken[hole]         = true;
+                remap[slot - count] = static_cast<uint32_t>(hole);
+            }
+        }
+
+        std::vector<uint32_t> keyAt(count);
+        for (size_t i = 0; i < count; ++i) {
+            keyAt[slots[i] < count ? slots[i] : remap[slots[i] - count]] = static_cast<uint32_t>(i);
+        }
+
+        offsets.reserve(count + 1);
+        values.reserve(count);
+        for (auto key:keyAt) {
+            offsets.push_back(static_cast<uint32_t>(arena.size()));
+            arena += entries[key].first;
+            values.push_back(entries[key].second);
+        }
+        offsets.push_back(static_cast<uint32_t>(arena.size()));
+        return true;
+    }
+
+    uint64_t              hashSeed{0};
+    size_t                tableSize{0};
+    size_t                denseBuckets{0};
+    std::vector<uint16_t> pilots{};
+    std::vector<uint32_t> remap{};
+    std::string           arena{};
+    std::vector<uint32_t> offsets{};
+    std::vector<T>        values{};
+};
+
+#endif //SHINGLES_PERFECT_HASH_HPP
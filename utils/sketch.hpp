@@ -0,0 +1,63 @@
+#ifndef SHINGLES_SKETCH_HPP
+#define SHINGLES_SKETCH_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+/**
+ * Count-min sketch with conservative update: a fixed amount of memory whatever the number of keys,
+ * estimates never under count and only the counters holding the minimum are raised.
+ */
+class CountMinSketch {
+public:
+    // Width is rounded up to a power of two
+    explicit CountMinSketch(unsigned long width = 1 << 20, unsigned int depth = 4) : depth(depth) {
+        while (this->width < width) {
+            this->width <<= 1;
+        }
+        counters.assign(this->width * depth, 0);
+    }
+
+    // Count one more occurrence of the key, returns its new estimated count
+    unsigned long add(uint64_t key) {
+        unsigned long estimate = this->estimate(key) + 1;
+        if (estimate > std::numeric_limits<uint32_t>::max()) {
+            return estimate - 1;
+        }
+        for (unsigned int row = 0; row < depth; ++row) {
+            uint32_t &counter = counters[index(key, row)];
+            counter = std::max(counter, static_cast<uint32_t>(estimate));
+        }
+        return estimate;
+    }
+
+    unsigned long estimate(uint64_t key) const {
+        uint32_t estimate = std::numeric_limits<uint32_t>::max();
+        for (unsigned int row = 0; row < depth; ++row) {
+            estimate = std::min(estimate, counters[index(key, row)]);
+        }
+        return estimate;
+    }
+
+    unsigned long bytes() const {
+        return counters.size() * sizeof(uint32_t);
+    }
+
+private:
+    size_t index(uint64_t key, unsigned int row) const {
+        // splitmix64 finalizer, seeded differently for each row
+        uint64_t x = key + (row + 1) * 0x9E3779B97F4A7C15ULL;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+        x ^= x >> 31;
+        return row * width + static_cast<size_t>(x & (width - 1));
+    }
+
+    unsigned long         width{1};
+    unsigned int          depth;
+    std::vector<uint32_t> counters{};
+};
+
+#endif //SHINGLES_SKETCH_HPP
@@ -0,0 +1,457 @@
+#include <cstdint>
+#include <cstring>
+#include "text.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SHINGLES_X86 1
+#include <immintrin.h>
+#endif
+
+namespace Text {
+
+    namespace {
+
+        /**
+         * Simple case mappings for code points below U+0180 (ASCII, Latin-1 Supplement and Latin
+         * Extended-A). Every mapping keeps the UTF-8 length, so folding is done in place.
+         */
+        struct CaseTable {
+            static constexpr uint16_t size = 0x180;
+            uint16_t                  lower[size];
+            uint16_t                  upper[size];
+
+            CaseTable() {
+                for (uint16_t c = 0; c < size; ++c) {
+                    lower[c] = upper[c] = c;
+                }
+                auto pair = [this](uint16_t capital, uint16_t small) {
+                    lower[capital] = small;
+                    upper[small]   = capital;
+                };
+                for (uint16_t c = 'A'; c <= 'Z'; ++c) {
+                    pair(c, c + 0x20);
+                }
+                for (uint16_t c = 0xC0; c <= 0xDE; ++c) {
+                    if (c != 0xD7) { // ×
+                        pair(c, c + 0x20);
+                    }
+                }
+                for (uint16_t c = 0x100; c < 0x178; c += 2) {
+                    if (c == 0x138) { // ĸ has no capital, pairs restart on odd code points until Ŋ
+                        for (c = 0x139; c < 0x149; c += 2) {
+                            pair(c, c + 1);
+                        }
+                        c = 0x148;
+                    } else if (c != 0x130) { // İ and ı only fold in Turkic languages
+                        pair(c, c + 1);
+                    }
+                }
+                pair(0x178, 0xFF); // Ÿ
+                for (uint16_t c = 0x179; c < 0x17F; c += 2) {
+                    pair(c, c + 1);
+                }
+            }
+        };
+
+        const CaseTable &caseTable() {
+            static const CaseTable table{};
+            return table;
+        }
+
+        /**
+         * Map the character at data[i] through the table, returns the index of the next character.
+         * Only two byte sequences can be in the table (C2-C5 lead bytes), anything else is skipped
+         * a byte at a time.
+         */
+        inline size_t mapCharacter(char *data, size_t i, size_t size, const uint16_t *table) {
+            auto lead = static_cast<unsigned char>(data[i]);
+            if (lead < 0x80) {
+                data[i] = static_cast<char>(table[lead]);
+                return i + 1;
+            }
+            if (lead >= 0xC2 && lead <= 0xC5 && i + 1 < size && (static_cast<unsigned char>(data[i + 1]) & 0xC0) == 0x80) {
+                uint16_t c = table[((lead & 0x1F) << 6) | (data[i + 1] & 0x3F)];
+                data[i]     = static_cast<char>(0xC0 | (c >> 6));
+                data[i + 1] = static_cast<char>(0x80 | (c & 0x3F));
+                return i + 2;
+            }
+            return i + 1;
+        }
+
+        // Scalar kernels, also used for the tails of the vectorized ones
+
+        // Lowercase from data[i] until end, returns where it stopped as a sequence can cross end
+        size_t lowercaseScalar(char *data, size_t i, size_t end, size_t size) {
+            const uint16_t *lower = caseTable().lower;
+            while (i < end) {
+                i = mapCharacter(data, i, size, lower);
+            }
+            return i;
+        }
+
+        void replaceControlScalar(char *data, size_t begin, size_t size) {
+            for (size_t i = begin; i < size; ++i) {
+                auto c = static_cast<unsigned char>(data[i]);
+                if (c < 0x20 || c == '_') {
+                    data[i] = ' ';
+                }
+            }
+        }
+
+        // Collapse spaces from data[read] on, writing at data[write], returns the new size
+        size_t collapseScalar(char *data, size_t read, size_t write, size_t size) {
+            for (; read < size; ++read) {
+                if (data[read] != ' ' || write == 0 || data[write - 1] != ' ') {
+                    data[write++] = data[read];
+                }
+            }
+            return write;
+        }
+
+        inline bool isPunctuation(char c) {
+            switch (c) {
+                case '.':
+                case ',':
+                case ':':
+                case ';':
+                case '!':
+                case '?':
+                case '(':
+                case ')':
+                case '"':
+                    return true;
+                default:
+                    return false;
+            }
+        }
+
+        /**
+         * Handle the character at text[i], which is either ASCII punctuation or the start of a
+         * multi-byte UTF-8 sequence. Returns the index of the next character.
+         */
+        size_t separateCharacter(const std::string &text, size_t i, std::string &out) {
+            auto c = static_cast<unsigned char>(text[i]);
+
+            if (c < 0x80) {
+                if (c == '.' && text.compare(i, 3, "...") == 0) {
+                    out += " … ";
+                    return i + 3;
+                }
+                out += ' ';
+                out += text[i];
+                out += ' ';
+                return i + 1;
+            }
+
+            // Length of the UTF-8 sequence, stray continuation bytes are copied one by one
+            size_t length = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+            length = std::min(length, text.size() - i);
+
+            const char *sequence = text.data() + i;
+            bool        separate = (length == 2 && (std::memcmp(sequence, "«", 2) == 0 || std::memcmp(sequence, "»", 2) == 0))
+                                   || (length == 3 && (std::memcmp(sequence, "“", 3) == 0 || std::memcmp(sequence, "”", 3) == 0
+                                                       || std::memcmp(sequence, "…", 3) == 0));
+            if (separate) {
+                out += ' ';
+            }
+            out.append(sequence, length);
+            if (separate) {
+                out += ' ';
+            }
+            return i + length;
+        }
+
+        void separateScalar(const std::string &text, size_t i, std::string &out) {
+            while (i < text.size()) {
+                if (isPunctuation(text[i]) || static_cast<unsigned char>(text[i]) >= 0x80) {
+                    i = separateCharacter(text, i, out);
+                } else {
+                    out += text[i++];
+                }
+            }
+        }
+
+        struct Kernels {
+            const char *name;
+            void (*lowercase)(std::string &);
+            void (*replaceControl)(std::string &);
+            void (*collapse)(std::string &);
+            void (*separate)(const std::string &, std::string &);
+        };
+
+        const Kernels scalar{
+            "scalar",
+            [](std::string &text) {
+                lowercaseScalar(&text[0], 0, text.size(), text.size());
+            },
+            [](std::string &text) {
+                replaceControlScalar(&text[0], 0, text.size());
+            },
+            [](std::string &text) {
+                text.resize(collapseScalar(&text[0], 0, 0, text.size()));
+            },
+            [](const std::string &text, std::string &out) {
+                separateScalar(text, 0, out);
+            }
+        };
+
+#ifdef SHINGLES_X86
+
+        // SSE2, always available on x86-64
+
+        void lowercaseSse2(std::string &text) {
+            char         *data = &text[0];
+            size_t       size  = text.size();
+            size_t       i     = 0;
+            const __m128i before = _mm_set1_epi8('A' - 1);
+            const __m128i after  = _mm_set1_epi8('Z' + 1);
+            const __m128i offset = _mm_set1_epi8('a' - 'A');
+            while (i + 16 <= size) {
+                __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+                if (_mm_movemask_epi8(chars) != 0) {
+                    // Multi-byte sequences go through the table
+                    i = lowercaseScalar(data, i, i + 16, size);
+                    continue;
+                }
+                __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(chars, before), _mm_cmplt_epi8(chars, after));
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(data + i), _mm_add_epi8(chars, _mm_and_si128(upper, offset)));
+                i += 16;
+            }
+            lowercaseScalar(data, i, size, size);
+        }
+
+        void replaceControlSse2(std::string &text) {
+            char          *data = &text[0];
+            size_t        size  = text.size();
+            size_t        i     = 0;
+            const __m128i limit      = _mm_set1_epi8(0x20);
+            const __m128i minus      = _mm_set1_epi8(-1);
+            const __m128i underscore = _mm_set1_epi8('_');
+            const __m128i space      = _mm_set1_epi8(' ');
+            for (; i + 16 <= size; i += 16) {
+                __m128i chars   = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+                __m128i control = _mm_and_si128(_mm_cmpgt_epi8(chars, minus), _mm_cmplt_epi8(chars, limit));
+                __m128i mask    = _mm_or_si128(control, _mm_cmpeq_epi8(chars, underscore));
+                if (_mm_movemask_epi8(mask) != 0) {
+                    chars = _mm_or_si128(_mm_andnot_si128(mask, chars), _mm_and_si128(mask, space));
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(data + i), chars);
+                }
+            }
+            replaceControlScalar(data, i, size);
+        }
+
+        void collapseSse2(std::string &text) {
+            char          *data = &text[0];
+            size_t        size  = text.size();
+            size_t        read  = 0;
+            size_t        write = 0;
+            const __m128i space = _mm_set1_epi8(' ');
+            while (read + 16 <= size) {
+                __m128i      chars  = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + read));
+                unsigned int spaces = static_cast<unsigned int>(_mm_movemask_epi8(_mm_cmpeq_epi8(chars, space)));
+                // Space following a space, including the last written byte
+                unsigned int previous = write > 0 && data[write - 1] == ' ' ? 1 : 0;
+                if ((spaces & ((spaces << 1) | previous)) == 0) {
+                    // Nothing to collapse, move the whole block (write <= read, the block is already loaded)
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(data + write), chars);
+                    read += 16;
+                    write += 16;
+                } else {
+                    write = collapseScalar(data, read, write, read + 16);
+                    read += 16;
+                }
+            }
+            text.resize(collapseScalar(data, read, write, size));
+        }
+
+        // Bytes that need the scalar path: ASCII punctuation or any byte of a multi-byte sequence
+        inline unsigned int specialSse2(__m128i chars) {
+            __m128i mask = _mm_cmpeq_epi8(chars, _mm_set1_epi8('.'));
+            mask = _mm_or_si128(mask, _mm_cmpeq_epi8(chars, _mm_set1_epi8(',')));
+            mask = _mm_or_si128(mask, _mm_cmpeq_epi8(chars, _mm_set1_epi8(':')));
+            mask = _mm_or_si128(mask, _mm_cmpeq_epi8(chars, _mm_set1_epi8(';')));
+            mask = _mm_or_si128(mask, _mm_cmpeq_epi8(chars, _mm_set1_epi8('!')));
+            mask = _mm_or_si128(mask, _mm_cmpeq_epi8(chars, _mm_set1_epi8('?')));
+            mask = _mm_or_si128(mask, _mm_cmpeq_epi8(chars, _mm_set1_epi8('(')));
+            mask = _mm_or_si128(mask, _mm_cmpeq_epi8(chars, _mm_set1_epi8(')')));
+            mask = _mm_or_si128(mask, _mm_cmpeq_epi8(chars, _mm_set1_epi8('"')));
+            return static_cast<unsigned int>(_mm_movemask_epi8(mask) | _mm_movemask_epi8(chars));
+        }
+
+        void separateSse2(const std::string &text, std::string &out) {
+            const char *data = text.data();
+            size_t     size  = text.size();
+            size_t     i     = 0;
+            while (i + 16 <= size) {
+                unsigned int special = specialSse2(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i)));
+                if (special == 0) {
+                    out.append(data + i, 16);
+                    i += 16;
+                } else {
+                    auto plain = static_cast<size_t>(__builtin_ctz(special));
+                    out.append(data + i, plain);
+                    i = separateCharacter(text, i + plain, out);
+                }
+            }
+            separateScalar(text, i, out);
+        }
+
+        const Kernels sse2{
+            "sse2",
+            lowercaseSse2,
+            replaceControlSse2,
+            collapseSse2,
+            separateSse2
+        };
+
+        // AVX2, selected at runtime
+
+        __attribute__((target("avx2")))
+        void lowercaseAvx2(std::string &text) {
+            char          *data = &text[0];
+            size_t        size  = text.size();
+            size_t        i     = 0;
+            const __m256i before = _mm256_set1_epi8('A' - 1);
+            const __m256i after  = _mm256_set1_epi8('Z' + 1);
+            const __m256i offset = _mm256_set1_epi8('a' - 'A');
+            while (i + 32 <= size) {
+                __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+                if (_mm256_movemask_epi8(chars) != 0) {
+                    i = lowercaseScalar(data, i, i + 32, size);
+                    continue;
+                }
+                __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(chars, before), _mm256_cmpgt_epi8(after, chars));
+                _mm256_storeu_si256(reinterpret_cast<__m256i *>(data + i), _mm256_add_epi8(chars, _mm256_and_si256(upper, offset)));
+                i += 32;
+            }
+            lowercaseScalar(data, i, size, size);
+        }
+
+        __attribute__((target("avx2")))
+        void replaceControlAvx2(std::string &text) {
+            char          *data = &text[0];
+            size_t        size  = text.size();
+            size_t        i     = 0;
+            const __m256i limit      = _mm256_set1_epi8(0x20);
+            const __m256i minus      = _mm256_set1_epi8(-1);
+            const __m256i underscore = _mm256_set1_epi8('_');
+            const __m256i space      = _mm256_set1_epi8(' ');
+            for (; i + 32 <= size; i += 32) {
+                __m256i chars   = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+                __m256i control = _mm256_and_si256(_mm256_cmpgt_epi8(chars, minus), _mm256_cmpgt_epi8(limit, chars));
+                __m256i mask    = _mm256_or_si256(control, _mm256_cmpeq_epi8(chars, underscore));
+                if (_mm256_movemask_epi8(mask) != 0) {
+                    _mm256_storeu_si256(reinterpret_cast<__m256i *>(data + i), _mm256_blendv_epi8(chars, space, mask));
+                }
+            }
+            replaceControlScalar(data, i, size);
+        }
+
+        __attribute__((target("avx2")))
+        void collapseAvx2(std::string &text) {
+            char          *data = &text[0];
+            size_t        size  = text.size();
+            size_t        read  = 0;
+            size_t        write = 0;
+            const __m256i space = _mm256_set1_epi8(' ');
+            while (read + 32 <= size) {
+                __m256i      chars    = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + read));
+                auto         spaces   = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chars, space)));
+                unsigned int previous = write > 0 && data[write - 1] == ' ' ? 1 : 0;
+                if ((spaces & ((spaces << 1) | previous)) == 0) {
+                    _mm256_storeu_si256(reinterpret_cast<__m256i *>(data + write), chars);
+                    read += 32;
+                    write += 32;
+                } else {
+                    write = collapseScalar(data, read, write, read + 32);
+                    read += 32;
+                }
+            }
+            text.resize(collapseScalar(data, read, write, size));
+        }
+
+        __attribute__((target("avx2")))
+        void separateAvx2(const std::string &text, std::string &out) {
+            const char *data = text.data();
+            size_t     size  = text.size();
+            size_t     i     = 0;
+            while (i + 32 <= size) {
+                __m256i chars = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+                __m256i mask  = _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('.'));
+                mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(chars, _mm256_set1_epi8(',')));
+                mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(chars, _mm256_set1_epi8(':')));
+                mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(chars, _mm256_set1_epi8(';')));
+                mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('!')));
+                mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('?')));
+                mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('(')));
+                mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(chars, _mm256_set1_epi8(')')));
+                mask = _mm256_or_si256(mask, _mm256_cmpeq_epi8(chars, _mm256_set1_epi8('"')));
+                auto special = static_cast<unsigned int>(_mm256_movemask_epi8(mask) | _mm256_movemask_epi8(chars));
+                if (special == 0) {
+                    out.append(data + i, 32);
+                    i += 32;
+                } else {
+                    auto plain = static_cast<size_t>(__builtin_ctz(special));
+                    out.append(data + i, plain);
+                    i = separateCharacter(text, i + plain, out);
+                }
+            }
+            separateScalar(text, i, out);
+        }
+
+        const Kernels avx2{
+            "avx2",
+            lowercaseAvx2,
+            replaceControlAvx2,
+            collapseAvx2,
+            separateAvx2
+        };
+
+#endif
+
+        const Kernels &selected() {
+            static const Kernels &kernels =
+#ifdef SHINGLES_X86
+                __builtin_cpu_supports("avx2") ? avx2 : sse2;
+#else
+                scalar;
+#endif
+            return kernels;
+        }
+    }
+
+    const char *kernels() {
+        return selected().name;
+    }
+
+    void lowercase(std::string &text) {
+        if (!text.empty()) {
+            selected().lowercase(text);
+        }
+    }
+
+    void capitalize(std::string &text) {
+        if (!text.empty()) {
+            mapCharacter(&text[0], 0, text.size(), caseTable().upper);
+        }
+    }
+
+    void replaceControlCharacters(std::string &text) {
+        if (!text.empty()) {
+            selected().replaceControl(text);
+        }
+    }
+
+    void collapseSpaces(std::string &text) {
+        if (!text.empty()) {
+            selected().collapse(text);
+        }
+    }
+
+    std::string separatePunctuation(const std::string &text) {
+        std::string out{};
+        out.reserve(text.size() + text.size() / 4);
+        selected().separate(text, out);
+        return out;
+    }
+}
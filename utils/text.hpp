@@ -0,0 +1,28 @@
+#pragma once
+
+#include <string>
+
+/**
+ * Byte level text passes of the parser, vectorized with SSE2 or AVX2 when the CPU supports it
+ * (selected once at runtime) with a scalar fallback. Multi-byte UTF-8 sequences are never split.
+ */
+namespace Text {
+    // Name of the selected kernels: "avx2", "sse2" or "scalar"
+    const char *kernels();
+
+    // Lowercase in place, folding ASCII, Latin-1 Supplement and Latin Extended-A capitals
+    void lowercase(std::string &text);
+
+    // Uppercase the first character in place, same ranges as lowercase
+    void capitalize(std::string &text);
+
+    // Replace control characters (0x00-0x1F) and underscores with spaces, in place
+    void replaceControlCharacters(std::string &text);
+
+    // Collapse runs of spaces into a single space, in place
+    void collapseSpaces(std::string &text);
+
+    // Surround punctuation with spaces so that it becomes words: . , : ; ! ? ( ) " “ ” « »
+    // and "..." which becomes …
+    std::string separatePunctuation(const std::string &text);
+}